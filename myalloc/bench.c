@@ -0,0 +1,485 @@
+/*
+ * Filename: bench.c
+ *
+ * Description: Benchmark for the custom memory allocator. Replays synthetic workloads and recorded traces against
+ *              every allocation algorithm and glibc malloc, and reports throughput, latency percentiles, peak RSS
+ *              and the fragmentation left at the end of the run. Every run is a growable allocator that
+ *              starts with -m MB, so its peak RSS and fragmentation follow the memory the workload needs.
+ *
+ *              Usage: ./bench [-n ops] [-m initial_mb] [-s seed] [-t trace_file]
+ *
+ *              A trace has one operation per line: "a <id> <size>" allocates block id, "r <id> <size>" reallocates
+ *              it and "f <id>" frees it. Ids are small non-negative integers that can be reused after a free.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "myalloc.h"
+
+// Number of live block slots of the random workloads
+#define LIVE_SLOTS 10000
+// Short-lived blocks of the lifetime mix are freed after this many newer short-lived blocks
+#define SHORT_LIVED 32
+// Capacity of the queue between the producer and the consumer
+#define QUEUE_SIZE 1024
+
+// Allocator under test, either an allocation algorithm of myalloc or glibc malloc
+struct bench_allocator {
+    const char* name;
+    bool libc;
+    enum allocation_algorithm algorithm;
+    int flags;
+};
+
+static const struct bench_allocator allocators[] = {
+    { "first-fit", false, FIRST_FIT, MYALLOC_GROWABLE },
+    { "best-fit", false, BEST_FIT, MYALLOC_GROWABLE },
+    { "worst-fit", false, WORST_FIT, MYALLOC_GROWABLE },
+    { "segregated-fit", false, SEGREGATED_FIT, MYALLOC_GROWABLE },
+    { "seg+tcache+slabs", false, SEGREGATED_FIT, MYALLOC_GROWABLE | MYALLOC_THREAD_CACHE | MYALLOC_SLABS },
+    { "glibc", true, 0, 0 },
+};
+
+// One traced operation
+struct trace_op {
+    char op;        // 'a', 'r' or 'f'
+    int id;
+    size_t size;
+};
+
+// Latencies of one thread of a run
+struct latencies {
+    uint32_t *ns;
+    size_t count;
+    size_t capacity;
+};
+
+// State of a run, one workload against one allocator
+struct run {
+    const struct bench_allocator *allocator;
+    struct Myalloc *heap;
+    size_t ops;
+    uint64_t seed;
+    struct latencies latencies[2];
+    size_t failures;
+    double fragmentation;   // 1 - largest free chunk / free memory at the end of the workload, -1 for glibc
+};
+
+static size_t memory_size = (size_t)1 << 20;
+static struct trace_op *trace = NULL;
+static size_t trace_length = 0;
+static int trace_ids = 0;
+
+/**
+ * Description: Returns the next number of the xorshift generator at _state.
+ */
+static uint64_t next_random(uint64_t* _state) {
+    uint64_t x = *_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *_state = x;
+}
+
+/**
+ * Description: Returns the monotonic clock in nanoseconds.
+ */
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Description: Records a latency of _ns nanoseconds.
+ */
+static void record(struct latencies* _latencies, uint64_t _ns) {
+    if (_latencies->count < _latencies->capacity) {
+        _latencies->ns[_latencies->count++] = _ns > UINT32_MAX ? UINT32_MAX : (uint32_t)_ns;
+    }
+}
+
+static void* bench_alloc(struct run* _run, struct latencies* _latencies, size_t _size) {
+    uint64_t start = now_ns();
+    void* ptr = _run->allocator->libc ? malloc(_size) : myalloc_alloc(_run->heap, _size);
+    record(_latencies, now_ns() - start);
+    if (ptr == NULL) {
+        _run->failures++;
+    } else {
+        memset(ptr, 0xa5, _size);
+    }
+    return ptr;
+}
+
+static void* bench_realloc(struct run* _run, struct latencies* _latencies, void* _ptr, size_t _size) {
+    uint64_t start = now_ns();
+    void* ptr = _run->allocator->libc ? realloc(_ptr, _size) : myalloc_realloc(_run->heap, _ptr, _size);
+    record(_latencies, now_ns() - start);
+    if (ptr == NULL) {
+        _run->failures++;
+        return _ptr;
+    }
+    memset(ptr, 0x5a, _size);
+    return ptr;
+}
+
+static void bench_free(struct run* _run, struct latencies* _latencies, void* _ptr) {
+    uint64_t start = now_ns();
+    if (_run->allocator->libc) {
+        free(_ptr);
+    } else {
+        myalloc_free(_run->heap, _ptr);
+    }
+    record(_latencies, now_ns() - start);
+}
+
+/**
+ * Description: Records the fragmentation of the free memory while the blocks still live at the end of the workload
+ *              are allocated.
+ */
+static void record_fragmentation(struct run* _run) {
+    _run->fragmentation = -1.0;
+    if (!_run->allocator->libc) {
+        struct myalloc_stats stats;
+        myalloc_get_statistics(_run->heap, &stats);
+        _run->fragmentation = stats.free_size ? 1.0 - (double)stats.largest_free_chunk_size / stats.free_size : 0.0;
+    }
+}
+
+/**
+ * Description: Returns a size from 1 to 1024 bytes, every size equally likely.
+ */
+static size_t uniform_size(uint64_t* _state) {
+    return 1 + next_random(_state) % 1024;
+}
+
+/**
+ * Description: Returns a size from 8 bytes to 64 KB from a Pareto distribution, most blocks are small and a few
+ *              are very large like the buffers of real programs.
+ */
+static size_t power_law_size(uint64_t* _state) {
+    double u = (next_random(_state) >> 11) * (1.0 / 9007199254740992.0);
+    double size = 8.0 * pow(1.0 - u, -1.0 / 1.2);
+    return size > 65536.0 ? 65536 : (size_t)size;
+}
+
+/**
+ * Description: Toggles random slots of a table of live blocks, so about half of the slots are live at a time.
+ */
+static void run_random(struct run* _run, size_t (*_size)(uint64_t*)) {
+    void** live = calloc(LIVE_SLOTS, sizeof(void*));
+    uint64_t state = _run->seed;
+    for (size_t i = 0; i < _run->ops; i++) {
+        size_t slot = next_random(&state) % LIVE_SLOTS;
+        if (live[slot] != NULL) {
+            bench_free(_run, &_run->latencies[0], live[slot]);
+            live[slot] = NULL;
+        } else {
+            live[slot] = bench_alloc(_run, &_run->latencies[0], _size(&state));
+        }
+    }
+    record_fragmentation(_run);
+    for (size_t slot = 0; slot < LIVE_SLOTS; slot++) {
+        if (live[slot] != NULL) {
+            bench_free(_run, &_run->latencies[0], live[slot]);
+        }
+    }
+    free(live);
+}
+
+static void run_uniform(struct run* _run) {
+    run_random(_run, uniform_size);
+}
+
+static void run_power_law(struct run* _run) {
+    run_random(_run, power_law_size);
+}
+
+/**
+ * Description: Mixes short-lived blocks, freed after SHORT_LIVED newer ones, with one in ten long-lived blocks that
+ *              stay in a table until a later long-lived block replaces them. The long-lived blocks pin the memory the
+ *              short-lived blocks churn through, which is what fragments a heap.
+ */
+static void run_lifetimes(struct run* _run) {
+    void** live = calloc(LIVE_SLOTS, sizeof(void*));
+    void* recent[SHORT_LIVED] = {NULL};
+    uint64_t state = _run->seed;
+    for (size_t i = 0; i < _run->ops; i++) {
+        if (next_random(&state) % 10 == 0) {
+            size_t slot = next_random(&state) % LIVE_SLOTS;
+            if (live[slot] != NULL) {
+                bench_free(_run, &_run->latencies[0], live[slot]);
+            }
+            live[slot] = bench_alloc(_run, &_run->latencies[0], power_law_size(&state));
+        } else {
+            size_t slot = i % SHORT_LIVED;
+            if (recent[slot] != NULL) {
+                bench_free(_run, &_run->latencies[0], recent[slot]);
+            }
+            recent[slot] = bench_alloc(_run, &_run->latencies[0], uniform_size(&state));
+        }
+    }
+    record_fragmentation(_run);
+    for (size_t slot = 0; slot < LIVE_SLOTS; slot++) {
+        if (live[slot] != NULL) {
+            bench_free(_run, &_run->latencies[0], live[slot]);
+        }
+    }
+    for (size_t slot = 0; slot < SHORT_LIVED; slot++) {
+        if (recent[slot] != NULL) {
+            bench_free(_run, &_run->latencies[0], recent[slot]);
+        }
+    }
+    free(live);
+}
+
+// Single producer, single consumer queue of blocks
+struct queue {
+    void* blocks[QUEUE_SIZE];
+    atomic_size_t head;     // next block the consumer takes
+    atomic_size_t tail;     // next free entry of the producer
+    struct run *run;
+};
+
+static void* consume(void* _queue) {
+    struct queue *queue = _queue;
+    size_t head = 0;
+    for (size_t i = 0; i < queue->run->ops / 2; i++) {
+        while (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+            sched_yield();
+        }
+        void* ptr = queue->blocks[head % QUEUE_SIZE];
+        atomic_store_explicit(&queue->head, ++head, memory_order_release);
+        if (ptr != NULL) {
+            bench_free(queue->run, &queue->run->latencies[1], ptr);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Description: One thread allocates blocks and hands them to a second thread that frees them, so every block is
+ *              freed by a thread other than the one that allocated it.
+ */
+static void run_producer_consumer(struct run* _run) {
+    struct queue *queue = calloc(1, sizeof(struct queue));
+    queue->run = _run;
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, consume, queue);
+    uint64_t state = _run->seed;
+    size_t tail = 0;
+    for (size_t i = 0; i < _run->ops / 2; i++) {
+        void* ptr = bench_alloc(_run, &_run->latencies[0], power_law_size(&state) % 4096 + 1);
+        while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == QUEUE_SIZE) {
+            sched_yield();
+        }
+        queue->blocks[tail % QUEUE_SIZE] = ptr;
+        atomic_store_explicit(&queue->tail, ++tail, memory_order_release);
+    }
+    pthread_join(consumer, NULL);
+    record_fragmentation(_run);
+    free(queue);
+}
+
+/**
+ * Description: Replays the loaded trace, the number of operations of the run is the length of the trace.
+ */
+static void run_trace(struct run* _run) {
+    void** live = calloc(trace_ids, sizeof(void*));
+    for (size_t i = 0; i < trace_length; i++) {
+        struct trace_op *op = &trace[i];
+        if (op->op == 'a' && live[op->id] == NULL) {
+            live[op->id] = bench_alloc(_run, &_run->latencies[0], op->size);
+        } else if (op->op == 'r' && live[op->id] != NULL) {
+            live[op->id] = bench_realloc(_run, &_run->latencies[0], live[op->id], op->size);
+        } else if (op->op == 'f' && live[op->id] != NULL) {
+            bench_free(_run, &_run->latencies[0], live[op->id]);
+            live[op->id] = NULL;
+        }
+    }
+    record_fragmentation(_run);
+    for (int id = 0; id < trace_ids; id++) {
+        if (live[id] != NULL) {
+            bench_free(_run, &_run->latencies[0], live[id]);
+        }
+    }
+    free(live);
+}
+
+/**
+ * Description: Reads the trace at _path into trace. Returns false if the file cannot be read or is malformed.
+ */
+static bool load_trace(const char* _path) {
+    FILE *file = fopen(_path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    size_t capacity = 1024;
+    trace = malloc(capacity * sizeof(struct trace_op));
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        struct trace_op op = { 0 };
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        int fields = sscanf(line, " %c %d %zu", &op.op, &op.id, &op.size);
+        bool valid = op.id >= 0 && ((op.op == 'f' && fields >= 2) || ((op.op == 'a' || op.op == 'r') && fields == 3 &&
+                                                                      op.size > 0));
+        if (!valid) {
+            fprintf(stderr, "Malformed trace line: %s", line);
+            fclose(file);
+            return false;
+        }
+        if (trace_length == capacity) {
+            capacity *= 2;
+            trace = realloc(trace, capacity * sizeof(struct trace_op));
+        }
+        trace[trace_length++] = op;
+        if (op.id >= trace_ids) {
+            trace_ids = op.id + 1;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static int compare_latencies(const void* _a, const void* _b) {
+    uint32_t a = *(const uint32_t*)_a;
+    uint32_t b = *(const uint32_t*)_b;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Description: Returns the peak resident set size of the process in KB, or 0 if it is not known.
+ */
+static long peak_rss_kb() {
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == NULL) {
+        return 0;
+    }
+    char line[256];
+    long kb = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "VmHWM: %ld", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(file);
+    return kb;
+}
+
+/**
+ * Description: Resets the peak resident set size of the process to its current size.
+ */
+static void reset_peak_rss() {
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (file != NULL) {
+        fputs("5", file);
+        fclose(file);
+    }
+}
+
+/**
+ * Description: Runs _workload against _allocator and prints one row of the results. Every run is a child process,
+ *              so the peak RSS of a run does not include the memory of the runs before it.
+ */
+static void run_benchmark(const char* _name, void (*_workload)(struct run*), const struct bench_allocator* _allocator,
+                          size_t _ops, uint64_t _seed) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) {
+        waitpid(pid, NULL, 0);
+        return;
+    }
+
+    struct run run = { .allocator = _allocator, .ops = _ops, .seed = _seed };
+    // every op is an allocation and a deallocation at most, in one of the two threads
+    for (int t = 0; t < 2; t++) {
+        run.latencies[t].capacity = 2 * _ops + 2 * LIVE_SLOTS;
+        run.latencies[t].ns = malloc(run.latencies[t].capacity * sizeof(uint32_t));
+        memset(run.latencies[t].ns, 0, run.latencies[t].capacity * sizeof(uint32_t));
+    }
+    if (!_allocator->libc) {
+        run.heap = myalloc_create(memory_size, _allocator->algorithm, _allocator->flags);
+        if (run.heap == NULL) {
+            printf("%-18s %-17s could not create a %zu MB allocator\n", _name, _allocator->name, memory_size >> 20);
+            exit(1);
+        }
+    }
+    reset_peak_rss();
+
+    uint64_t start = now_ns();
+    _workload(&run);
+    uint64_t elapsed = now_ns() - start;
+    long rss = peak_rss_kb();
+
+    char fragmentation[16] = "-";
+    if (!_allocator->libc) {
+        snprintf(fragmentation, sizeof(fragmentation), "%.3f", run.fragmentation);
+        myalloc_destroy(run.heap);
+    }
+
+    size_t count = run.latencies[0].count + run.latencies[1].count;
+    uint32_t *ns = run.latencies[0].ns;
+    memcpy(ns + run.latencies[0].count, run.latencies[1].ns, run.latencies[1].count * sizeof(uint32_t));
+    qsort(ns, count, sizeof(uint32_t), compare_latencies);
+    printf("%-18s %-17s %12.0f %8u %8u %8u %12ld %6s %8zu\n", _name, _allocator->name,
+           count * 1e9 / (elapsed ? elapsed : 1), ns[count / 2], ns[count * 99 / 100], ns[count * 999 / 1000], rss,
+           fragmentation, run.failures);
+    fflush(stdout);
+    _exit(0);
+}
+
+int main(int argc, char* argv[]) {
+    size_t ops = 1000000;
+    uint64_t seed = 88172645463325252ull;
+    const char* trace_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:m:s:t:")) != -1) {
+        switch (opt) {
+            case 'n': ops = strtoull(optarg, NULL, 10); break;
+            case 'm': memory_size = strtoull(optarg, NULL, 10) << 20; break;
+            case 's': seed = strtoull(optarg, NULL, 10) | 1; break;
+            case 't': trace_path = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n ops] [-m initial_mb] [-s seed] [-t trace_file]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (trace_path != NULL && !load_trace(trace_path)) {
+        fprintf(stderr, "Could not read the trace %s\n", trace_path);
+        return 1;
+    }
+
+    struct {
+        const char* name;
+        void (*run)(struct run*);
+    } workloads[] = {
+        { "uniform", run_uniform },
+        { "power-law", run_power_law },
+        { "lifetime-mix", run_lifetimes },
+        { "producer-consumer", run_producer_consumer },
+        { "trace", run_trace },
+    };
+    int num_workloads = sizeof(workloads) / sizeof(workloads[0]) - (trace == NULL);
+
+    printf("%-18s %-17s %12s %8s %8s %8s %12s %6s %8s\n", "workload", "allocator", "ops/s", "p50 ns", "p99 ns",
+           "p999 ns", "peak RSS KB", "frag", "failed");
+    for (int w = 0; w < num_workloads; w++) {
+        for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++) {
+            run_benchmark(workloads[w].name, workloads[w].run, &allocators[a], workloads[w].run == run_trace ? trace_length : ops, seed);
+        }
+    }
+    free(trace);
+    return 0;
+}
@@ -8,14 +8,16 @@
 
 #include <stdio.h>
 #include "myalloc.h"
-#include "list.h"
 
 int main(int argc, char* argv[]) {
-    //initialize_allocator(100, FIRST_FIT);
-    initialize_allocator(100, BEST_FIT);
-    // initialize_allocator(100, WORST_FIT);
-    //printf("Using first fit algorithm on memory size 100\n");
-    printf("Using best fit algorithm on memory size 100\n");
+    // Every block takes at least 56 bytes of the memory chunk (a 40-byte payload and its tags), so the 10 blocks
+    // below need more than the 100 bytes a block of 12 bytes used to need
+    //initialize_allocator(1000, FIRST_FIT);
+    initialize_allocator(1000, BEST_FIT);
+    // initialize_allocator(1000, WORST_FIT);
+    // initialize_allocator(1000, SEGREGATED_FIT);
+    //printf("Using first fit algorithm on memory size 1000\n");
+    printf("Using best fit algorithm on memory size 1000\n");
 
     int* p[50] = {NULL};
     for(int i=0; i<10; ++i) {
@@ -31,7 +33,7 @@ int main(int argc, char* argv[]) {
     print_statistics();
 
     for (int i = 0; i < 10; ++i) {
-        if (i % 2 == 0)
+        if (i % 2 == 0 || p[i] == NULL)
             continue;
 
         printf("Freeing p[%d]\n", i);
@@ -39,7 +41,7 @@ int main(int argc, char* argv[]) {
         p[i] = NULL;
     }
 
-    printf("available_memory %d\n", available_memory());
+    printf("available_memory %zu\n", available_memory());
 
     void* before[100] = {NULL};
     void* after[100] = {NULL};
@@ -7,516 +7,4195 @@
  */
 
 #include <assert.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include "myalloc.h"
-#include "list.h"
+
+#define HEADER_SIZE 8
+#define FOOTER_SIZE 8
+
+// Every chunk is surrounded by boundary tags: a header before the block and a footer after it.
+// Both tags are one 64-bit word with the same layout:
+//      bits 0-2    flags (BLOCK_ALLOCATED, BLOCK_FIXED, BLOCK_HANDLE)
+//      bits 3-63   size of the block in bytes, sizes are multiples of 8 so the size is the tag with the flags cleared
+//      MYALLOC_HARDENED builds keep a checksum of bits 0-47 in bits 48-63 (TAG_CHECKSUM), sizes stay below 2^48
+#define BLOCK_ALLOCATED 0x1
+// Set on chunks that compaction does not move: chunks from allocate_aligned() that are aligned beyond the minimum
+// alignment, slabs and regions
+#define BLOCK_FIXED 0x2
+// Set on chunks from allocate_handle(), the last word of the payload (before the canary) holds the index of the handle
+#define BLOCK_HANDLE 0x4
+#define BLOCK_FLAGS ((size_t)0x7)
+#define BLOCK_TAG(block) (*((size_t*)((char*)(block) - HEADER_SIZE)))
+#ifdef MYALLOC_HARDENED
+#define TAG_BITS ((((size_t)1) << 48) - 1)
+#define TAG_CHECKSUM(tag) (((tag) * 0x9e3779b97f4a7c15ull) & ~TAG_BITS)
+#define BLOCK_SIZE_BITS (TAG_BITS & ~BLOCK_FLAGS)
+// The last word of the payload of every allocated chunk is a canary right before the footer, an overflow past the
+// end of the block overwrites it first
+#define CANARY_SIZE sizeof(size_t)
+#define CANARY(block) (*((size_t*)((char*)(block) + BLOCK_SIZE(block) - CANARY_SIZE)))
+#define CANARY_VALUE(size) (((size) * 0xc2b2ae3d27d4eb4full) ^ 0x8badf00d5eedc0deull)
+#else
+#define BLOCK_SIZE_BITS (~BLOCK_FLAGS)
+#define CANARY_SIZE 0
+#endif
+#define BLOCK_SIZE(block) (BLOCK_TAG(block) & BLOCK_SIZE_BITS)
+
+// Free chunks of size [2^k, 2^(k+1)) are kept in bins[k] when using SEGREGATED_FIT
+#define NUM_SIZE_CLASSES 64
+// Number of chunks of the request's own bin SEGREGATED_FIT looks at before it takes a chunk of a higher bin
+#define SEGREGATED_SEARCH_LIMIT 8
+
+// Requests are rounded up to a multiple of 8 so that the boundary tags stay aligned
+#define ALIGNMENT 8
+// Largest minimum alignment of an allocator, a growable allocator grows by whole pages
+#define MAX_MIN_ALIGNMENT 4096
+
+// Links stored inside the memory chunk (free list links, tree nodes and slab lists) hold the distance from the link
+// to the chunk it points to, 0 for NULL, so they stay valid when the memory chunk is mapped at another address
+static inline void* link_get(const intptr_t* _link) {
+    return *_link == 0 ? NULL : (char*)_link + *_link;
+}
+
+static inline void link_set(intptr_t* _link, void* _ptr) {
+    *_link = _ptr == NULL ? 0 : (intptr_t)((char*)_ptr - (char*)_link);
+}
+
+// A free chunk keeps its free list links at the start of its own payload
+struct free_links {
+    intptr_t next;
+    intptr_t prev;
+};
+#define FREE_LINKS(block) ((struct free_links*)(block))
+
+// Node of a left-leaning red-black tree of free chunks, stored in the payload of the chunk it belongs to
+//      - children are links to the payloads of their chunks
+//      - the red bit of a node is the lowest bit of its left link, payloads and nodes are 8-byte aligned
+struct tree_node {
+    intptr_t left;
+    intptr_t right;
+};
+#define TREE_RED ((intptr_t)1)
+
+// Every free chunk is also in allocator->address_tree, ordered by address. Each node keeps the largest chunk size
+// of its subtree, so the first chunk that fits in address order is found in O(log n).
+struct address_node {
+    struct tree_node node;
+    size_t max_size;
+};
+
+// Without SEGREGATED_FIT the free chunks are kept in allocator->size_tree ordered by size and address instead of
+// a free list, so best fit is a lower bound search and worst fit is the last chunk of the tree
+
+// Payload of a free chunk
+struct free_chunk {
+    union {
+        struct free_links links;        // SEGREGATED_FIT
+        struct tree_node by_size;       // FIRST_FIT, BEST_FIT and WORST_FIT
+    };
+    struct address_node by_address;
+};
+#define ADDRESS_NODE(block) (&((struct free_chunk*)(block))->by_address)
+
+// Smallest payload of any chunk, a chunk must be able to hold its free list links and tree node once it is freed
+#define MIN_CHUNK_SIZE sizeof(struct free_chunk)
+
+// A handle block stores its handle index in the last word of its payload (before the canary), after the caller's data
+#define HANDLE_INDEX_SIZE sizeof(size_t)
+#define HANDLE_INDEX(block) (*((size_t*)((char*)(block) + BLOCK_SIZE(block) - CANARY_SIZE - HANDLE_INDEX_SIZE)))
+// The handle table starts with HANDLE_TABLE_MIN entries and doubles when it is full
+#define HANDLE_TABLE_MIN 64
+
+// Entry of the handle table, free entries are linked through next_free
+struct handle_entry {
+    void* block;        // NULL while the entry is free
+    int pins;           // compaction does not move the block while it is pinned
+    int next_free;
+};
+
+// Per-thread caches (MYALLOC_THREAD_CACHE) keep up to TCACHE_CAPACITY free chunks for each of TCACHE_NUM_CLASSES
+// size classes, and move TCACHE_BATCH chunks at a time between the cache and the shared memory chunk
+//      - class 0 holds the smallest chunk chunk_size() returns (at least MIN_CHUNK_SIZE bytes), every further class
+//        TCACHE_CLASS_SIZE bytes more, or the minimum alignment if that is larger, see tcache_class()
+#define TCACHE_CLASS_SIZE 16
+#define TCACHE_NUM_CLASSES 16
+#define TCACHE_CAPACITY 32
+#define TCACHE_BATCH 16
+// Growable allocators (MYALLOC_GROWABLE) map at least GROW_SEGMENT_SIZE bytes at a time, and keep up to
+// GROW_SEGMENT_SIZE bytes of free memory at the end of the memory chunk when giving memory back
+#define GROW_SEGMENT_SIZE (1 << 20)
+
+// Huge page size used for MYALLOC_HUGE_PAGES and MYALLOC_TRANSPARENT_HUGE_PAGES (the x86-64 and arm64 default)
+#define HUGE_PAGE_SIZE (2 << 20)
+
+// A thread keeps caches for up to TCACHE_SLOTS allocators at once, other allocators are used without a cache
+#define TCACHE_SLOTS 4
+
+// Largest number of CPUs a NUMA node's CPU list is read for, and the number of calls a thread's NUMA node is cached
+#define NUMA_MAX_CPUS 4096
+#define NUMA_NODE_REFRESH 256
+// mbind() mode that only allocates pages from the given nodes, from <numaif.h>
+#define NUMA_MPOL_BIND 2
+
+// First word of a persistent memory chunk file (myalloc_open()), "myalloc1"
+#define PERSISTENT_MAGIC 0x31636f6c6c61796dull
+
+// With MYALLOC_SLABS requests of up to SLAB_MAX_SIZE bytes are served from slabs: SLAB_SIZE-aligned chunks of the
+// memory chunk split into slots of one power-of-two size from SLAB_MIN_SIZE to SLAB_MAX_SIZE, without tags
+#define SLAB_SIZE (16 << 10)
+#define SLAB_MIN_SIZE 16
+#define SLAB_MAX_SIZE 128
+#define SLAB_NUM_CLASSES 4
+#define SLAB_BITMAP_WORDS (SLAB_SIZE / SLAB_MIN_SIZE / 64)
+
+#ifdef MYALLOC_HARDENED
+// Freed chunks of up to QUARANTINE_MAX_SIZE bytes wait in one of QUARANTINE_SIZE entries before they are reused
+#define QUARANTINE_SIZE 64
+#define QUARANTINE_MAX_SIZE (64 << 10)
+// First word of quarantined and cached chunks and of free slots, checked before they are reused to catch writes
+// after the free. Slots end with a canary like chunks.
+#define FREED_POISON 0xdeadfa11deadfa11ull
+#endif
+
+// Header at the start of a slab, the slots follow it
+struct slab {
+    intptr_t next;          // link to the next slab of the size class with free slots
+    intptr_t prev;
+    unsigned slot_size;
+    unsigned slot_offset;   // offset of the first slot, a multiple of slot_size
+    unsigned slots;
+    unsigned free_slots;
+    unsigned long long free_bitmap[SLAB_BITMAP_WORDS];     // bit i is set when slot i is free
+};
+
+struct thread_cache {
+    // Only contended when another thread drains the cache (compaction, myalloc_destroy)
+    pthread_mutex_t lock;
+    // Only changed by the owning thread, a cache is unregistered when its allocator is destroyed
+    struct Myalloc *allocator;
+    bool registered;
+    int count[TCACHE_NUM_CLASSES];
+    void* chunks[TCACHE_NUM_CLASSES][TCACHE_CAPACITY];
+    struct thread_cache *next;      // next cache in allocator->thread_caches
+};
 
 struct Myalloc {
     enum allocation_algorithm aalgorithm;
-    int size;
+    size_t size;
     void* memory;
     // Some other data members you want, 
     // such as lists to record allocated/free memory
-    struct nodeStruct *free_list;
-    struct nodeStruct *allocated_list;
-    int available_memory;
-    int used_memory;
+    //      - free chunks are linked through their payload, allocated chunks are only found through their tags
+    //      - size_tree holds the free chunks ordered by size unless SEGREGATED_FIT is used, smallest_free and
+    //        largest_free are its first and last chunk and are kept up to date on every insert and remove
+    void* size_tree;
+    void* smallest_free;
+    void* largest_free;
+    // Statistics kept up to date by every operation, so they can be read without the lock
+    atomic_size_t available_memory;
+    atomic_size_t used_memory;
+    atomic_int free_chunks;
+    atomic_int allocated_chunks;
     pthread_mutex_t lock;
+    // Size-class bins for SEGREGATED_FIT (used instead of size_tree), bit k of bin_bitmap is set when bins[k] is non-empty
+    void* bins[NUM_SIZE_CLASSES];
+    unsigned long long bin_bitmap;
+    int flags;
+    // Length of the mmap'd memory holding the allocator (0 if the memory chunk was malloc'd),
+    // for a growable allocator only the first ALLOCATOR_SIZE + size + tags bytes are accessible
+    size_t reserved_size;
+    size_t initial_size;
+    long page_size;
+    // Every chunk starts at a multiple of min_alignment: the memory chunk starts aligned and the payload of
+    // every chunk is rounded so that the chunk with its tags takes a multiple of min_alignment bytes
+    int min_alignment;
+    // Caches of all threads that used the allocator, protected by tcache_registry_lock
+    struct thread_cache *thread_caches;
+    // Chunk where the next compact_step() continues, NULL when the next step starts a new pass
+    //      - always the start of a chunk, deallocate moves it to the start of the merged chunk
+    void* compact_cursor;
+    // Root of the tree of all free chunks ordered by address, NULL when there are no free chunks
+    void* address_tree;
+    // Handle table of allocate_handle(), malloc'd separately so that it never moves during compaction
+    //      - first_free_handle is the first free entry, -1 when the table is full
+    struct handle_entry *handles;
+    int handle_capacity;
+    int first_free_handle;
+    // Slabs of each size class that have free slots (MYALLOC_SLABS)
+    //      - bit i of slab_pagemap is set when the SLAB_SIZE page at slab_base + i * SLAB_SIZE is a slab, so a pointer
+    //        is found to be a slot without touching the memory in front of it
+    //      - the pagemap covers the whole reserved memory chunk and is read without the lock: a page can only become
+    //        a slab or stop being one while none of its memory is allocated
+    struct slab *slabs[SLAB_NUM_CLASSES];
+    atomic_ullong *slab_pagemap;
+    uintptr_t slab_base;
+    size_t slab_pages;
+    // Bit i of block_map is set when an allocated chunk or slot starts at memory + i * ALIGNMENT, so deallocate can
+    // tell a block from any other pointer without trusting the memory in front of it
+    //      - mmap'd with block_map_size bytes to cover the whole reserved memory chunk, only touched pages take memory
+    atomic_ullong *block_map;
+    size_t block_map_size;
+    // Blocks freed by threads other than the owner of a MYALLOC_DEFERRED_FREE allocator, a stack linked through the
+    // first word of each block that is pushed with a CAS and emptied by the next allocation under the lock
+    _Atomic(void*) deferred_frees;
+    _Atomic(void*) owner;       // &thread_marker of the owning thread
+    // Persistent allocators (myalloc_open()) are a shared mapping of a file that starts with the allocator
+    //      - magic and layout_size identify a file written by the same build, mapped_at is the address the file was
+    //        mapped at so the pointers of the allocator can be moved when it is mapped at another address
+    //      - in_use is set while the file is open, a file that was not closed cleanly is not opened again
+    //      - file is the descriptor of the file, -1 for allocators that are not persistent
+    //      - shared allocators (myalloc_shm_create()) use the same layout in a shared memory object that several
+    //        processes map at mapped_at at the same time
+    uint64_t magic;
+    size_t layout_size;
+    struct Myalloc *mapped_at;
+    bool in_use;
+    bool shared;
+    void* root;
+    int file;
+#ifdef MYALLOC_TRACE
+    // Sampled tracing, see set_trace(): every trace_period-th call of a thread goes to trace_ring and trace_fn
+    //      - trace_fn is always NULL in a shared allocator, a function address is only valid in one process
+    atomic_uint trace_period;
+    _Atomic(myalloc_trace_fn) trace_fn;
+    _Atomic(void*) trace_arg;
+    struct trace_ring *trace_ring;
+#endif
+#ifdef MYALLOC_HARDENED
+    // Quarantined chunks, see quarantine_chunk(): still tagged allocated but out of the block map, NULL entries are empty
+    void* quarantine[QUARANTINE_SIZE];
+#endif
+};
+
+// Each allocator sits at the start of its own malloc'd memory, padded to a multiple of 64 bytes
+#define ALLOCATOR_SIZE ((sizeof(struct Myalloc) + 63) / 64 * 64)
+
+// Allocator behind initialize_allocator(), allocate(), deallocate(), ...
+static struct Myalloc *myalloc = NULL;
+// Arenas of the default allocator, arenas[node] with MYALLOC_NUMA and only myalloc otherwise
+static struct Myalloc *arenas[MYALLOC_MAX_NUMA_NODES];
+static int arena_count = 0;
+
+// Lock order: tcache_registry_lock, then a thread_cache lock, then allocator->lock
+static pthread_mutex_t tcache_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;
+static __thread struct thread_cache tcache[TCACHE_SLOTS] = {
+    [0 ... TCACHE_SLOTS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+
+// Region of the calling thread between region_begin() and region_end(), allocations bump top from start to end
+//      - allocator is NULL while the thread has no region
+struct region {
+    struct Myalloc *allocator;
+    char* start;
+    char* top;
+    char* end;
+    char* last;     // the latest block, the only one that can be resized in place
+};
+static __thread struct region region = { .allocator = NULL };
+
+// Its address identifies the calling thread, see Myalloc.owner
+static __thread char thread_marker;
+
+// NUMA node of the calling thread and the number of calls until it is looked up again
+static __thread int numa_node = 0;
+static __thread unsigned numa_node_countdown = 0;
+
+#ifdef MYALLOC_TRACE
+// Number of events the trace ring holds until a reader drains it
+#define TRACE_RING_SIZE 4096
+
+// Entry of the trace ring. sequence is the ring position the entry is written at next while it is empty, that
+// position + 1 once its event is written, and the position + TRACE_RING_SIZE again after the event is read
+struct trace_slot {
+    atomic_size_t sequence;
+    struct myalloc_trace_event event;
 };
 
-struct Myalloc myalloc;
+// Bounded ring of trace events written by any number of threads and drained by readers without locks
+struct trace_ring {
+    atomic_size_t head;     // next position to write
+    atomic_size_t tail;     // next position to read
+    atomic_size_t dropped;  // events lost because the ring was full
+    struct trace_slot slots[TRACE_RING_SIZE];
+};
+
+// Calls the calling thread makes until its next sampled call
+static __thread unsigned trace_countdown = 0;
+#endif
+
+#ifdef MYALLOC_HARDENED
+// State of the calling thread's xorshift generator that picks quarantine entries and cached chunks, 0 until seeded
+static __thread uint64_t random_state = 0;
+#endif
 
 /**
- * Description: Initialize the memory allocator. 
- *              _size indicates the contiguous memory chunk size that is assumed for the rest of the program:
- *                  - it should align to the nearest next 64-byte boundary (round up)
- *                  - Ex) If the requested size is 120 bytes, internally you should round it up to 128 bytes
- *                  - stats information should base on the actual chunk size
- *                  - any requests for allocation and deallocation requests will be served from this contiguous chunk
- *              You must allocate the memory chunk using malloc.
- *              The memory chunk must be pre-faulted.
- *              Its content initialized to 0 (using memset).
+ * Description: Writes the header and footer of the chunk at block.
  */
-void initialize_allocator(int _size, enum allocation_algorithm _aalgorithm) {
-    assert(_size > 0);
-    myalloc.aalgorithm = _aalgorithm;
+static void set_tags(void* block, size_t size, size_t allocated) {
+    size_t tag = size | allocated;
+#ifdef MYALLOC_HARDENED
+    tag |= TAG_CHECKSUM(tag);
+    if (allocated & BLOCK_ALLOCATED) {
+        *((size_t*)((char*)block + size - CANARY_SIZE)) = CANARY_VALUE(size);
+    }
+#endif
+    *((size_t*)((char*)block - HEADER_SIZE)) = tag;
+    *((size_t*)((char*)block + size)) = tag;
+}
 
-    // Intialize the mutex
-    pthread_mutex_init(&myalloc.lock, NULL);
+/**
+ * Description: Reports a misuse of the allocator, or a file or shared memory object it can not use, on stderr. Running
+ *              out of memory is not reported, it is the NULL an allocation returns. stdout belongs to the program,
+ *              which does not even know it uses the allocator when it is preloaded.
+ */
+static void report_error(const char* _format, ...) {
+    va_list args;
+    va_start(args, _format);
+    vfprintf(stderr, _format, args);
+    va_end(args);
+}
 
-    // Calculate the rounded size (nearest 64-byte boundary)
-    int rounded_size = ((_size + 63) / 64) * 64;
-    myalloc.size = rounded_size;
-    int total_size = rounded_size + HEADER_SIZE;
-    // Allocate the memory chunk with space for the header
-    void* ptr = malloc(total_size);
-    if (ptr == NULL) {
-        printf("Error: initialize_allocator malloc failed");
-        exit(1);
+#ifdef MYALLOC_HARDENED
+/**
+ * Description: Reports heap corruption found at _ptr and aborts.
+ */
+static void heap_corruption(const char* _error, void* _ptr) {
+    fprintf(stderr, "myalloc: %s at %p\n", _error, _ptr);
+    abort();
+}
+#endif
+
+/**
+ * Description: Reports a call of _function with a pointer that is not an allocated block. MYALLOC_HARDENED builds
+ *              abort, since it is usually a double free.
+ */
+static void invalid_pointer(const char* _function, void* _ptr) {
+#ifdef MYALLOC_HARDENED
+    heap_corruption("double free or pointer that is not an allocated block", _ptr);
+#endif
+    report_error("Error: %s of a pointer that is not an allocated block.\n", _function);
+}
+
+/**
+ * Description: Aborts if the header checksum, the footer or the canary of the allocated chunk at block was
+ *              overwritten. Does nothing unless built with MYALLOC_HARDENED.
+ */
+static void check_chunk(void* block) {
+#ifdef MYALLOC_HARDENED
+    size_t tag = BLOCK_TAG(block);
+    if (TAG_CHECKSUM(tag & TAG_BITS) != (tag & ~TAG_BITS) || !(tag & BLOCK_ALLOCATED)) {
+        heap_corruption("corrupted block header", block);
+    }
+    if (*((size_t*)((char*)block + BLOCK_SIZE(block))) != tag) {
+        heap_corruption("corrupted block footer", block);
     }
-    // Pre-fault the memory chunk and initialize to 0
-    memset(ptr, 0, total_size);
-    // Points to the memory chunk after the header
-    myalloc.memory = (void*)((char*)ptr + HEADER_SIZE);
+    if (CANARY(block) != CANARY_VALUE(BLOCK_SIZE(block))) {
+        heap_corruption("write past the end of the block", block);
+    }
+#endif
+}
 
-    // Initialize allocated list and free list
-    myalloc.allocated_list = NULL;
-    myalloc.free_list = List_createNode(myalloc.memory);
-    *((size_t*)((char*)myalloc.memory - HEADER_SIZE)) = (size_t)myalloc.size;  // update header with size information
+/**
+ * Description: Marks the chunk at block as allocated or not in the block map.
+ */
+static void block_map_set(struct Myalloc *allocator, void* block, bool allocated) {
+    size_t i = ((char*)block - (char*)allocator->memory) / ALIGNMENT;
+    if (allocated) {
+        atomic_fetch_or_explicit(&allocator->block_map[i / 64], 1ull << (i % 64), memory_order_relaxed);
+    } else {
+        atomic_fetch_and_explicit(&allocator->block_map[i / 64], ~(1ull << (i % 64)), memory_order_relaxed);
+    }
+}
 
-    // Store statistics information
-    myalloc.available_memory = myalloc.size;
-    myalloc.used_memory = 0;
+/**
+ * Description: Returns true if an allocated chunk starts at _ptr. Pointers outside the memory chunk, pointers into a
+ *              block and pointers to free or already freed chunks all return false, also chunks in thread caches.
+ *              Allocated slots return true as well, the callers look for a slab first.
+ */
+static bool is_block(struct Myalloc *allocator, void* _ptr) {
+    uintptr_t offset = (uintptr_t)_ptr - (uintptr_t)allocator->memory;
+    if ((uintptr_t)_ptr < (uintptr_t)allocator->memory || offset / ALIGNMENT / 8 >= allocator->block_map_size ||
+        offset % ALIGNMENT != 0) {
+        return false;
+    }
+    size_t i = offset / ALIGNMENT;
+    return (atomic_load_explicit(&allocator->block_map[i / 64], memory_order_relaxed) & (1ull << (i % 64))) != 0;
 }
 
 /**
- * Description: Similar to malloc call in C.
- *              Returns a pointer to the allocated block of size _size.
- *              If allocation cannot be satisfied, returns NULL
+ * Description: Clears the block map bit of the allocated block at block. Returns false if another thread cleared it
+ *              first, so of two racing deallocations of the same block only one goes ahead.
  */
-void* allocate(int _size) {
-    assert(_size > 0);
-    void* ptr = NULL;
+static bool block_map_claim(struct Myalloc *allocator, void* block) {
+    size_t i = ((char*)block - (char*)allocator->memory) / ALIGNMENT;
+    unsigned long long bit = 1ull << (i % 64);
+    return (atomic_fetch_and_explicit(&allocator->block_map[i / 64], ~bit, memory_order_relaxed) & bit) != 0;
+}
 
-    // Allocate memory from myalloc.memory 
-    // ptr = address of allocated memory
+/**
+ * Description: Returns true if the chunk at block is allocated (the prologue and epilogue count as allocated).
+ */
+static bool is_allocated(void* block) {
+    return (BLOCK_TAG(block) & BLOCK_ALLOCATED) != 0;
+}
 
-    // Lock the mutex before accesing shared data structures
-    pthread_mutex_lock(&myalloc.lock);
+/**
+ * Description: Returns true if block is the epilogue marking the end of the memory chunk.
+ */
+static bool is_epilogue(void* block) {
+    return BLOCK_SIZE(block) == 0;
+}
 
-    struct nodeStruct *curr = myalloc.free_list;
-    if (curr == NULL) {
-        // Lock the mutex before returning
-        pthread_mutex_unlock(&myalloc.lock);    
-        printf("The free list is empty. No room to allocate.\n");
-        return NULL;
-    }
-    // Find the appropriate chunk from the free list to allocate
-    switch(myalloc.aalgorithm) {
-        // Use the first hole that is big enough
-        case FIRST_FIT: {
-            while (curr) {
-                int curr_free_size = abs(*((char*)curr->block - HEADER_SIZE));
-                if (curr_free_size >= _size) {
-                    ptr = curr->block;
-                    break;
-                }
-                curr = curr->next;
-            }
-            break;
-        }
-        // Use the smallest hole that is big enough (must traverse the entire free list)
-        case BEST_FIT: {
-            while (curr) {
-                int curr_free_size = abs(*((char*)curr->block - HEADER_SIZE));
-                if (curr_free_size >= _size) {                                  // the current chunk is large enough
-                    if (ptr == NULL) {                                          // all the previous chunks were too small
-                        ptr = curr->block;
-                    } else if (curr_free_size < *((char*)ptr - HEADER_SIZE)) {  // this chunk is smaller than all the previous chunks
-                        ptr = curr->block;
-                    }
-                }
-                curr = curr->next;
-            }
-            break;
-        }
-        // Use the largest hole that is big enough (must traverse the entire free list)
-        case WORST_FIT: {
-            while (curr) {
-                int curr_free_size = abs(*((char*)curr->block - HEADER_SIZE));
-                if (curr_free_size >= _size) {                                  // the current chunk is large enough
-                    if (ptr == NULL) {                                          // all the previous chunks were too small
-                        ptr = curr->block;
-                    } else if (curr_free_size > *((char*)ptr - HEADER_SIZE)) {  // this chunk is larger than all the previous chunks
-                        ptr = curr->block;
-                    }
-                }
-                curr = curr->next;
-            }
-            break;
-        }
-        default: {
-            pthread_mutex_unlock(&myalloc.lock);
-            printf("BRUH ERROR\n");
-            exit(1);
-            break;
-        }
-    }
+/**
+ * Description: Returns the chunk physically to the right of block, or the epilogue at the end of the memory chunk.
+ */
+static void* next_block(void* block) {
+    return (char*)block + BLOCK_SIZE(block) + FOOTER_SIZE + HEADER_SIZE;
+}
 
-    // If we can not find sufficient space, return NULL
-    if (ptr == NULL) {
-        pthread_mutex_unlock(&myalloc.lock);
-        printf("There are no free blocks large enough to allocate the requested size.\n");
+/**
+ * Description: Returns the chunk physically to the left of block if its footer says it is free.
+ *              Returns NULL if it is allocated or block is the first chunk in memory (the prologue counts as allocated).
+ */
+static void* prev_free_block(void* block) {
+    size_t prev_footer = *((size_t*)((char*)block - HEADER_SIZE - FOOTER_SIZE));
+    if (prev_footer & BLOCK_ALLOCATED) {
         return NULL;
     }
+    size_t prev_size = prev_footer & BLOCK_SIZE_BITS;
+    return (char*)block - HEADER_SIZE - FOOTER_SIZE - prev_size;
+}
 
-    if (ptr != NULL) {  // we found a sufficient chunk
-        // Update the allocated list with the chosen ptr from the free list
-        List_insertHead(&myalloc.allocated_list, List_createNode(ptr));
-        // Update the free list
-        //  - if there is space left in the free chunk, adjust the address and update the header
-        //      - if there is 8 bytes or less then do not keep it in the free list (no point in having a free chunk that can hold 0 bytes)
-        //  - if the whole chunk was used, remove the node from the free list
-        int ptr_free_size = abs(*((char*)ptr - HEADER_SIZE));
-        int leftover_free_space = ptr_free_size - _size;
-        if (leftover_free_space > 8) {
-            // adjust header for the allocated chunk
-                // new_size = _size;
-            *((char*)ptr - HEADER_SIZE) = _size;
-            // adjust address of chunk in free_list that was used and update the header
-                // new_address = old_address + _size + HEADER_SIZE
-                // new_size = old_size - _size - HEADER_SIZE = leftover_free_space - HEADER_SIZE
-            struct nodeStruct *chunk_free = List_findNode(myalloc.free_list, ptr);
-            chunk_free->block = (void*)((char*)chunk_free->block + _size + HEADER_SIZE);  // adjust address
-            *((char*)chunk_free->block - HEADER_SIZE) = leftover_free_space - HEADER_SIZE;   // update header
-        } else {
-            // remove the entire chunk from the free list
-            // header stays the same since we are allocating the whole free chunk
-            List_deleteNode(&myalloc.free_list, List_findNode(myalloc.free_list, ptr));
-        }
+/**
+ * Description: Returns the size class (bin index) of a chunk of the given size.
+ */
+static int size_class(size_t _size) {
+    if (_size <= 1) {
+        return 0;
     }
+    return 63 - __builtin_clzll(_size);
+}
 
-    // update statistics information: available_memory and used_memory
-    // new_available_memory = old_available_memory - size_ - HEADER_SIZE
-    myalloc.available_memory = available_memory();
-    myalloc.used_memory = used_memory();
+// Order and subtree data of a tree of free chunks
+struct tree_ops {
+    size_t offset;                          // offset of the tree_node in the payload of a free chunk
+    bool (*less)(void* _a, void* _b);       // true if the chunk at _a comes before the chunk at _b
+    void (*update)(void* _block);           // recomputes the subtree data of _block from its children, or NULL
+};
+#define TREE_NODE(tree, block) ((struct tree_node*)((char*)(block) + (tree)->offset))
 
-    pthread_mutex_unlock(&myalloc.lock);
-    return ptr;
+static void* node_left(struct tree_node *node) {
+    intptr_t left = node->left & ~TREE_RED;
+    return left == 0 ? NULL : (char*)&node->left + left;
+}
+
+static void* tree_left(const struct tree_ops *tree, void* block) {
+    return node_left(TREE_NODE(tree, block));
+}
+
+static void* tree_right(const struct tree_ops *tree, void* block) {
+    return link_get(&TREE_NODE(tree, block)->right);
+}
+
+static void tree_set_left(const struct tree_ops *tree, void* block, void* left) {
+    struct tree_node *node = TREE_NODE(tree, block);
+    intptr_t red = node->left & TREE_RED;
+    link_set(&node->left, left);
+    node->left |= red;
+}
+
+static void tree_set_right(const struct tree_ops *tree, void* block, void* right) {
+    link_set(&TREE_NODE(tree, block)->right, right);
 }
 
 /**
- * Description: Similar to free call in C.
- *              Takes a pointer to a chunk of memory as the sole parameter and returns it back to the allocator.
- * Precondition: The pointer is a valid entry in memory and is in the allocated list
+ * Description: Returns true if block is a red node, NULL children are black.
  */
-void deallocate(void* _ptr) {
-    assert(_ptr != NULL);
+static bool tree_is_red(const struct tree_ops *tree, void* block) {
+    return block != NULL && (TREE_NODE(tree, block)->left & TREE_RED) != 0;
+}
 
-    // Free allocated memory
-    // Note: _ptr points to the user-visible memory. The size information is
-    // stored at (char*)_ptr - 8.
+/**
+ * Description: Returns true if block has a red left child.
+ */
+static bool tree_is_red_left(const struct tree_ops *tree, void* block) {
+    return block != NULL && tree_is_red(tree, tree_left(tree, block));
+}
 
-    pthread_mutex_lock(&myalloc.lock);
+static void tree_set_red(const struct tree_ops *tree, void* block, bool red) {
+    struct tree_node *node = TREE_NODE(tree, block);
+    node->left = (node->left & ~TREE_RED) | (red ? TREE_RED : 0);
+}
 
-    // Iterate through the free_list and merge with adjacent chunks
-    // If found, we do not need to continue iterating through the list since we assume there are no adjacent chunks in the starting free list
-    int _ptr_size = abs(*((char*)_ptr - HEADER_SIZE));
-    struct nodeStruct *curr = myalloc.free_list;
-    if (curr == NULL) {
-        pthread_mutex_unlock(&myalloc.lock);
-        printf("Given NULL, unable to deallocate.\n");
-        return;
+static void tree_flip_colors(const struct tree_ops *tree, void* block) {
+    TREE_NODE(tree, block)->left ^= TREE_RED;
+    void* left = tree_left(tree, block);
+    void* right = tree_right(tree, block);
+    if (left != NULL) {
+        TREE_NODE(tree, left)->left ^= TREE_RED;
     }
-    while (curr) {
-        // found a chunk directly right to _ptr 
-        //      - i.e. its address is equal to (char*)_ptr + size(_ptr) + HEADER_SIZE 
-        if (curr->block == (char*)_ptr + _ptr_size + HEADER_SIZE) {
-            // _ptr is the new address
-            // adjust the header size information: new_size = _ptr_size + HEADER_SIZE + curr_size
-            // remove curr from the free list and insert ptr at the head of the free list
-            *((char*)_ptr - HEADER_SIZE) = _ptr_size + HEADER_SIZE + abs(*((char*)curr->block - HEADER_SIZE));
-            List_deleteNode(&myalloc.free_list, curr);
-            List_insertHead(&myalloc.free_list, List_createNode(_ptr));
-            _ptr_size = abs(*((char*)_ptr - HEADER_SIZE));
-            // Update statistics: myalloc.available_memory and myalloc.used_memory
-            myalloc.available_memory = available_memory();
-            myalloc.used_memory = used_memory();
-            pthread_mutex_unlock(&myalloc.lock);
-            return;
-        }
-        curr = curr->next;
-    }
-    while (curr) {
-        // found a chunk directly left to _ptr
-        //      - i.e. _ptr address is equal to (char*)curr->block + size(curr) + HEADER_SIZE
-        int curr_size = abs(*((char*)curr->block - HEADER_SIZE));
-        if (_ptr == (char*)curr->block + curr_size + HEADER_SIZE) {
-            // curr->block is the new address
-            // adjust the header size information: new_size = curr_size + HEADER_SIZE + _ptr_size
-            // remove curr from the free list and insert curr at the head of the free list 
-            //      - lecture notes indicate to always insert at list head when freeing allocated chunks)
-            *((char*)curr->block - HEADER_SIZE) = curr_size + HEADER_SIZE + abs(*((char*)_ptr - HEADER_SIZE));
-            List_deleteNode(&myalloc.free_list, curr);
-            List_insertHead(&myalloc.free_list, List_createNode(curr->block));
-            // Update statistics: myalloc.available_memory and myalloc.used_memory
-            myalloc.available_memory = available_memory();
-            myalloc.used_memory = used_memory();
-            pthread_mutex_unlock(&myalloc.lock);
-            return;
-        }
-        curr = curr->next;
+    if (right != NULL) {
+        TREE_NODE(tree, right)->left ^= TREE_RED;
     }
+}
 
-    // insert the chunk into the free list
-    List_deleteNode(&myalloc.allocated_list, List_findNode(myalloc.allocated_list, _ptr));
-    List_insertHead(&myalloc.free_list, List_createNode(_ptr));
+static void tree_update(const struct tree_ops *tree, void* block) {
+    if (tree->update != NULL) {
+        tree->update(block);
+    }
+}
 
-    // Update statistics: myalloc.available_memory and myalloc.used_memory
-    myalloc.available_memory = available_memory();
-    myalloc.used_memory = used_memory();
+static void* tree_rotate_left(const struct tree_ops *tree, void* block) {
+    void* right = tree_right(tree, block);
+    tree_set_right(tree, block, tree_left(tree, right));
+    tree_set_left(tree, right, block);
+    tree_set_red(tree, right, tree_is_red(tree, block));
+    tree_set_red(tree, block, true);
+    tree_update(tree, block);
+    tree_update(tree, right);
+    return right;
+}
 
-    pthread_mutex_unlock(&myalloc.lock);
+static void* tree_rotate_right(const struct tree_ops *tree, void* block) {
+    void* left = tree_left(tree, block);
+    tree_set_left(tree, block, tree_right(tree, left));
+    tree_set_right(tree, left, block);
+    tree_set_red(tree, left, tree_is_red(tree, block));
+    tree_set_red(tree, block, true);
+    tree_update(tree, block);
+    tree_update(tree, left);
+    return left;
 }
 
 /**
- * Description: Returns the available memory (bytes) as an integer
+ * Description: Restores the left-leaning red-black invariants at block on the way back up and updates its subtree data.
+ *              Returns the new root of the subtree.
  */
-int available_memory() {
-    int available_memory_size = 0;
-    // Calculate available memory size
-    struct nodeStruct *curr = myalloc.free_list;
-    while (curr) {
-        int curr_size = abs(*((char*)curr->block - HEADER_SIZE));
-        available_memory_size += curr_size;
-        curr = curr->next;
+static void* tree_fix_up(const struct tree_ops *tree, void* block) {
+    if (tree_is_red(tree, tree_right(tree, block)) && !tree_is_red(tree, tree_left(tree, block))) {
+        block = tree_rotate_left(tree, block);
+    }
+    if (tree_is_red(tree, tree_left(tree, block)) && tree_is_red_left(tree, tree_left(tree, block))) {
+        block = tree_rotate_right(tree, block);
+    }
+    if (tree_is_red(tree, tree_left(tree, block)) && tree_is_red(tree, tree_right(tree, block))) {
+        tree_flip_colors(tree, block);
+    }
+    tree_update(tree, block);
+    return block;
+}
+
+static void* tree_insert_at(const struct tree_ops *tree, void* root, void* block) {
+    if (root == NULL) {
+        TREE_NODE(tree, block)->left = TREE_RED;
+        TREE_NODE(tree, block)->right = 0;
+        tree_update(tree, block);
+        return block;
+    }
+    if (tree->less(block, root)) {
+        tree_set_left(tree, root, tree_insert_at(tree, tree_left(tree, root), block));
+    } else {
+        tree_set_right(tree, root, tree_insert_at(tree, tree_right(tree, root), block));
     }
-    return available_memory_size;
+    return tree_fix_up(tree, root);
 }
 
 /**
- * Description: Returns the used memory (bytes) as an integer
+ * Description: Inserts the free chunk at block into the tree at *_root. The recursion is as deep as the tree,
+ *              which is at most 2 log2(n) for n free chunks.
+ */
+static void tree_insert(const struct tree_ops *tree, void** _root, void* block) {
+    *_root = tree_insert_at(tree, *_root, block);
+    tree_set_red(tree, *_root, false);
+}
+
+/**
+ * Description: Returns the first chunk of the non-empty subtree at root.
  */
-int used_memory() {
-    int used_memory_size = 0;
-    // Calculate used (allocated) memory size
-    struct nodeStruct *curr = myalloc.allocated_list;
-    while (curr) {
-        int curr_size = abs(*((char*)curr->block - HEADER_SIZE));
-        used_memory_size += curr_size;
-        curr = curr->next;
+static void* tree_min(const struct tree_ops *tree, void* root) {
+    for (void* left = tree_left(tree, root); left != NULL; left = tree_left(tree, root)) {
+        root = left;
     }
-    return used_memory_size;
+    return root;
 }
 
 /**
- * Description: Returns true if there is fragmentation. False if there is no fragmentation.
- *              Combine adjacent free chunks.
+ * Description: Returns the last chunk of the non-empty subtree at root.
  */
-bool is_fragmented() {
-    struct nodeStruct* curr_free = myalloc.free_list;
-    struct nodeStruct* curr_alloc = myalloc.allocated_list;
-    int num_free_nodes = List_countNodes(curr_free);
-    // No free space, not fragmented. Return false
-    if (num_free_nodes == 0) {
-        return false;
+static void* tree_max(const struct tree_ops *tree, void* root) {
+    for (void* right = tree_right(tree, root); right != NULL; right = tree_right(tree, root)) {
+        root = right;
     }
-    // More than one free node, is fragmented. Return true
-    // Check if adjacent free chunks to be combined
-    if (num_free_nodes > 1) {
-        curr_free = myalloc.free_list;
-        struct nodeStruct* current = NULL;
-        int has_adj = 0;    // 0 = none, 1 = left, 2 = right
-        struct nodeStruct* adjacent = NULL;
-        while (curr_free && (has_adj==0)) {
-            struct nodeStruct* curr_free_next = curr_free->next;  
-            int size_curr_free = abs(*((char*)curr_free->block - HEADER_SIZE));
-            while (curr_free_next) {
-                // if next address is to the right of curr: next_address == current_address + size(curr) + HEADER_SIZE
-                if (curr_free_next->block == (char*)curr_free->block + size_curr_free + HEADER_SIZE) {
-                    current = curr_free;
-                    adjacent = curr_free_next;
-                    has_adj = 2;
-                }
-                // if next address is to the left of curr: next_address + size(next) + HEADER_SIZE == current_address
-                int size_next_free = abs(*((char*)curr_free_next->block - HEADER_SIZE));
-                if (curr_free->block == (char*)curr_free_next->block + size_next_free + HEADER_SIZE) {
-                    current = curr_free;
-                    adjacent = curr_free_next;
-                    has_adj = 1;
-                }
-                curr_free_next = curr_free_next->next;
-            }
-            curr_free = curr_free->next;
-        }
-        // if there is an adjacent chunk to the right of the current chunk, address stays the same, update header with new size
-        // remove adjacent from the free list
-        if (has_adj == 2) {
-            int size_adj = abs(*((char*)adjacent->block - HEADER_SIZE));
-            int size_current = abs(*((char*)current->block - HEADER_SIZE));
-            int new_size = size_current + HEADER_SIZE + size_adj;
-            *((char*)current->block - HEADER_SIZE) = new_size;
-            List_deleteNode(&myalloc.free_list, adjacent);
-        }
-        // if there is an adjacent chunk to the left of the current, address becomes adjacent, update header with new size
-        // remove current from the free list
-        if (has_adj == 1) {
-            int size_adj = abs(*((char*)adjacent->block - HEADER_SIZE));
-            int size_current = abs(*((char*)current->block - HEADER_SIZE));
-            int new_size = size_adj + HEADER_SIZE + size_current;
-            *((char*)adjacent->block - HEADER_SIZE) = new_size;
-            List_deleteNode(&myalloc.free_list, current);
-        }
-        return true;
-    }
-    // If there is only one free node, we must check if it there is fragmentation
-    // Fragmented if address of the free node (there is only one) is smaller than any of the addresses of the allocated nodes
-    curr_free = myalloc.free_list;
-    while (curr_alloc) {
-        if (curr_free->block < curr_alloc->block) {
-            return true;
-        }
-        curr_alloc = curr_alloc->next;
+    return root;
+}
+
+// Moves a red link down to the left (tree_move_red_left()) or right (tree_move_red_right()) child of block,
+// so the chunk is removed from a node that is not a single 2-3 tree key
+static void* tree_move_red_left(const struct tree_ops *tree, void* block) {
+    tree_flip_colors(tree, block);
+    if (tree_is_red_left(tree, tree_right(tree, block))) {
+        tree_set_right(tree, block, tree_rotate_right(tree, tree_right(tree, block)));
+        block = tree_rotate_left(tree, block);
+        tree_flip_colors(tree, block);
     }
-    return false;
+    return block;
+}
+
+static void* tree_move_red_right(const struct tree_ops *tree, void* block) {
+    tree_flip_colors(tree, block);
+    if (tree_is_red_left(tree, tree_left(tree, block))) {
+        block = tree_rotate_right(tree, block);
+        tree_flip_colors(tree, block);
+    }
+    return block;
+}
+
+static void* tree_remove_min(const struct tree_ops *tree, void* root) {
+    if (tree_left(tree, root) == NULL) {
+        return NULL;
+    }
+    if (!tree_is_red(tree, tree_left(tree, root)) && !tree_is_red_left(tree, tree_left(tree, root))) {
+        root = tree_move_red_left(tree, root);
+    }
+    tree_set_left(tree, root, tree_remove_min(tree, tree_left(tree, root)));
+    return tree_fix_up(tree, root);
 }
 
+static void* tree_remove_at(const struct tree_ops *tree, void* root, void* block) {
+    if (tree->less(block, root)) {
+        if (!tree_is_red(tree, tree_left(tree, root)) && !tree_is_red_left(tree, tree_left(tree, root))) {
+            root = tree_move_red_left(tree, root);
+        }
+        tree_set_left(tree, root, tree_remove_at(tree, tree_left(tree, root), block));
+    } else {
+        if (tree_is_red(tree, tree_left(tree, root))) {
+            root = tree_rotate_right(tree, root);
+        }
+        if (block == root && tree_right(tree, root) == NULL) {
+            return NULL;
+        }
+        if (!tree_is_red(tree, tree_right(tree, root)) && !tree_is_red_left(tree, tree_right(tree, root))) {
+            root = tree_move_red_right(tree, root);
+        }
+        if (block == root) {
+            // the nodes are the chunks themselves, so the next chunk in order takes the place of block
+            void* next = tree_min(tree, tree_right(tree, root));
+            void* right = tree_remove_min(tree, tree_right(tree, root));
+            tree_set_left(tree, next, tree_left(tree, root));
+            tree_set_red(tree, next, tree_is_red(tree, root));
+            tree_set_right(tree, next, right);
+            root = next;
+        } else {
+            tree_set_right(tree, root, tree_remove_at(tree, tree_right(tree, root), block));
+        }
+    }
+    return tree_fix_up(tree, root);
+}
 
 /**
- * Description: Compaction will be performed by grouping the allocated memory blocks in the beginning of the memory
- *              chunk and combining the free memory at the end of the memory chunk.
- *              The return value is an integer which is the total number of pointers inserted in the _before/_after array.
+ * Description: Removes the free chunk at block from the tree at *_root, block must be in the tree.
  */
-int compact_allocation(void** _before, void** _after) {
-    pthread_mutex_lock(&myalloc.lock);
-    int compacted_size = 0;
-    if (myalloc.used_memory == 0) {
-        pthread_mutex_unlock(&myalloc.lock);
-        return 0;
+static void tree_remove(const struct tree_ops *tree, void** _root, void* block) {
+    void* root = *_root;
+    if (!tree_is_red(tree, tree_left(tree, root)) && !tree_is_red(tree, tree_right(tree, root))) {
+        tree_set_red(tree, root, true);
     }
-    if (myalloc.available_memory == 0) {
-        pthread_mutex_unlock(&myalloc.lock);
-        return 0;
+    *_root = tree_remove_at(tree, root, block);
+    if (*_root != NULL) {
+        tree_set_red(tree, *_root, false);
     }
-    // compact allocated memory
-    // update _before, _after and compacted_size
+}
 
-    struct nodeStruct *curr = myalloc.allocated_list;
-    if (curr == NULL) {
-        pthread_mutex_unlock(&myalloc.lock);
-        return 0;
+static bool address_less(void* _a, void* _b) {
+    return (char*)_a < (char*)_b;
+}
+
+/**
+ * Description: Sets the largest chunk size of the subtree at _block of the address tree.
+ */
+static void address_update(void* _block) {
+    struct address_node *node = ADDRESS_NODE(_block);
+    size_t max_size = BLOCK_SIZE(_block);
+    void* left = node_left(&node->node);
+    void* right = link_get(&node->node.right);
+    if (left != NULL && ADDRESS_NODE(left)->max_size > max_size) {
+        max_size = ADDRESS_NODE(left)->max_size;
     }
-    // while (curr) {
-    //     _before[compacted_size] = curr->block;
-    //     _after[compacted_size] = curr->block;
-    //     compacted_size++;
-    //     curr = curr->next;
-    // }
-    // Go through the free list to search for places to compact
-    curr = myalloc.free_list;
-    if (curr == NULL) {
-        pthread_mutex_unlock(&myalloc.lock);
-        return 0;
+    if (right != NULL && ADDRESS_NODE(right)->max_size > max_size) {
+        max_size = ADDRESS_NODE(right)->max_size;
     }
+    node->max_size = max_size;
+}
 
+static const struct tree_ops address_tree = {
+    .offset = offsetof(struct free_chunk, by_address),
+    .less = address_less,
+    .update = address_update,
+};
 
-    void* dest;
-    while (is_fragmented()) {
-        struct nodeStruct* leftmost_free = myalloc.free_list;
-        // struct nodeStruct* curr_alloc = myalloc.allocated_list;
-        struct nodeStruct* curr_free = myalloc.free_list;
-        // find the leftmost_free node
-        curr_free = curr_free->next;
-        while (curr_free) {
-            if (curr_free->block < leftmost_free->block) {
-                leftmost_free = curr_free;
-            }
-            curr_free = curr_free->next;
-        }
-        // find the adjacent allocatedchunk (directly to the right of the leftmost_free chunk)
-            // adjacent = left + size(left) + header
-        //int size_leftmost = abs(*((char*)leftmost_free->block - HEADER_SIZE));
-        //void* adj = (char*)leftmost_free->block + size_leftmost + HEADER_SIZE;
-        
-        // struct nodeStruct* adjacent = List_findNode(myalloc.allocated_list, adj);
-        struct nodeStruct* adjacent = NULL;
-        struct nodeStruct* alloc_adj = myalloc.allocated_list;
-        if (alloc_adj) {
-            if (alloc_adj->block > leftmost_free->block) {
-                if (adjacent == NULL) {
-                    adjacent = alloc_adj;
-                } else if (alloc_adj->block < adjacent->block) {
-                    adjacent = alloc_adj;
-                }
-            }
-            alloc_adj = alloc_adj->next;
-        }
-        
-        if (adjacent != NULL) {
-            // move the adjacent chunk over to where the free chunk is via memmove
-            dest = (char*)leftmost_free->block - HEADER_SIZE;
-            void* src = (char*)adjacent->block - HEADER_SIZE;
-            int size_dest = abs(*(char*)dest);
-            int size_src = abs(*(char*)src);
-            // a new free chunk will be created when src is moved to dest by the size of src (want to copy all of src)
-            // we also delete the free chunk we copied into
-            memmove(dest, src, size_src);
-            void* end_where_new_free_starts = (char*)dest + size_src + HEADER_SIZE;
-            List_deleteNode(&myalloc.free_list, leftmost_free);
-            if (List_findNode(myalloc.free_list, end_where_new_free_starts) == NULL) {
-                List_insertHead(&myalloc.free_list, List_createNode(end_where_new_free_starts));
-                // update header of new free: how many bytes we moved src by (size of dest)
-                int size_new_free = size_dest;
-                *((char*)end_where_new_free_starts - HEADER_SIZE) = size_new_free;
-            }
-        }
+/**
+ * Description: Returns the free chunk with the lowest address that holds _size bytes, or NULL if there is none.
+ *              Subtrees whose largest chunk is too small are skipped. allocator->lock must be held.
+ */
+static void* address_first_fit(struct Myalloc *allocator, size_t _size) {
+    void* curr = allocator->address_tree;
+    if (curr == NULL || ADDRESS_NODE(curr)->max_size < _size) {
+        return NULL;
     }
-    // update _after array and myalloc.allocated_list
-    struct nodeStruct* update_alloc = myalloc.allocated_list;
-    while (update_alloc != NULL) {
-        _before[compacted_size] = update_alloc->block;
-        update_alloc->block = dest + HEADER_SIZE;
-        _after[compacted_size] = update_alloc->block;
-        if (_before[compacted_size] != _after[compacted_size]) {
-            compacted_size++;
+    while (true) {
+        void* left = tree_left(&address_tree, curr);
+        if (left != NULL && ADDRESS_NODE(left)->max_size >= _size) {
+            curr = left;
+        } else if (BLOCK_SIZE(curr) >= _size) {
+            return curr;
+        } else {
+            curr = tree_right(&address_tree, curr);
         }
-        update_alloc = update_alloc->next;
     }
-    myalloc.available_memory = available_memory();
-    myalloc.used_memory = used_memory();
+}
 
-    pthread_mutex_unlock(&myalloc.lock);
-    return compacted_size;
+/**
+ * Description: Returns the free chunk with the lowest address, or NULL if there are no free chunks.
+ *              allocator->lock must be held.
+ */
+static void* first_free_chunk(struct Myalloc *allocator) {
+    return allocator->address_tree != NULL ? tree_min(&address_tree, allocator->address_tree) : NULL;
 }
 
 /**
- * Description: Prints the statistics of the memory allocator
+ * Description: Orders free chunks by size, chunks of the same size by address.
  */
-void print_statistics() {
-    int allocated_size = myalloc.size;
-    int allocated_chunks = List_countNodes(myalloc.allocated_list);
-    int free_size = myalloc.available_memory;
-    int free_chunks = List_countNodes(myalloc.free_list);
-    int smallest_free_chunk_size = List_smallest_chunk(&myalloc.free_list);
-    int largest_free_chunk_size = List_largest_chunk(&myalloc.free_list);
+static bool size_less(void* _a, void* _b) {
+    size_t a_size = BLOCK_SIZE(_a);
+    size_t b_size = BLOCK_SIZE(_b);
+    return a_size < b_size || (a_size == b_size && (char*)_a < (char*)_b);
+}
 
-    // Calculate the statistics
+static const struct tree_ops size_tree = {
+    .offset = offsetof(struct free_chunk, by_size),
+    .less = size_less,
+    .update = NULL,
+};
 
-    printf("Allocated size = %d\n", allocated_size);
-    printf("Allocated chunks = %d\n", allocated_chunks);
-    printf("Free size = %d\n", free_size);
-    printf("Free chunks = %d\n", free_chunks);
-    printf("Largest free chunk size = %d\n", largest_free_chunk_size);
-    printf("Smallest free chunk size = %d\n", smallest_free_chunk_size);
+/**
+ * Description: Returns the smallest free chunk of the size tree that holds _size bytes, the one with the lowest
+ *              address if several have that size, or NULL if there is none. allocator->lock must be held.
+ */
+static void* size_lower_bound(struct Myalloc *allocator, size_t _size) {
+    void* fit = NULL;
+    void* curr = allocator->size_tree;
+    while (curr != NULL) {
+        if (BLOCK_SIZE(curr) >= _size) {
+            fit = curr;
+            curr = tree_left(&size_tree, curr);
+        } else {
+            curr = tree_right(&size_tree, curr);
+        }
+    }
+    return fit;
 }
 
 /**
- * Description: Releases any dynamically allocated memory in your contiguous allocator.
+ * Description: Inserts the free chunk at block into its size index (its bin or the size tree) and the address tree.
+ *              The tags of the chunk must already hold its final size.
  */
-void destroy_allocator() {
-    free((char*)myalloc.memory - HEADER_SIZE);
-    pthread_mutex_destroy(&myalloc.lock);
-
-    // free other dynamic allocated memory to avoid memory leak
-    struct nodeStruct* curr1 = myalloc.allocated_list;
-	struct nodeStruct* curr2 = myalloc.free_list;
-	struct nodeStruct* prev1 = NULL;
-	struct nodeStruct* prev2 = NULL;
-	while(curr1 != NULL)
-	{
-		prev1 = curr1;
-		curr1 = curr1->next;
-		List_deleteNode(&myalloc.allocated_list, prev1);
-		
-	}
-	while(curr2 != NULL)
-	{   
-		prev2 = curr2;
-		curr2 = curr2->next;
-		List_deleteNode(&myalloc.free_list, prev2);    
-	}
+static void free_list_insert(struct Myalloc *allocator, void* block) {
+    size_t size = BLOCK_SIZE(block);
+    if (allocator->aalgorithm == SEGREGATED_FIT) {
+        // at the head of its bin
+        void** head = &allocator->bins[size_class(size)];
+        link_set(&FREE_LINKS(block)->prev, NULL);
+        link_set(&FREE_LINKS(block)->next, *head);
+        if (*head != NULL) {
+            link_set(&FREE_LINKS(*head)->prev, block);
+        }
+        *head = block;
+        allocator->bin_bitmap |= 1ull << size_class(size);
+    } else {
+        tree_insert(&size_tree, &allocator->size_tree, block);
+        if (allocator->smallest_free == NULL || size_less(block, allocator->smallest_free)) {
+            allocator->smallest_free = block;
+        }
+        if (allocator->largest_free == NULL || size_less(allocator->largest_free, block)) {
+            allocator->largest_free = block;
+        }
+    }
+    tree_insert(&address_tree, &allocator->address_tree, block);
+    atomic_fetch_add_explicit(&allocator->available_memory, size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocator->free_chunks, 1, memory_order_relaxed);
 }
 
+/**
+ * Description: Removes the free chunk at block from its size index and the address tree.
+ *              Must be called before the tags of the chunk are changed.
+ */
+static void free_list_remove(struct Myalloc *allocator, void* block) {
+    size_t size = BLOCK_SIZE(block);
+    if (allocator->aalgorithm == SEGREGATED_FIT) {
+        void** head = &allocator->bins[size_class(size)];
+        void* prev = link_get(&FREE_LINKS(block)->prev);
+        void* next = link_get(&FREE_LINKS(block)->next);
+        if (prev != NULL) {
+            link_set(&FREE_LINKS(prev)->next, next);
+        } else {
+            *head = next;
+        }
+        if (next != NULL) {
+            link_set(&FREE_LINKS(next)->prev, prev);
+        }
+        if (*head == NULL) {
+            allocator->bin_bitmap &= ~(1ull << size_class(size));
+        }
+    } else {
+        tree_remove(&size_tree, &allocator->size_tree, block);
+        // only removing the first or last chunk needs a walk down the tree
+        if (allocator->smallest_free == block) {
+            allocator->smallest_free = allocator->size_tree != NULL ? tree_min(&size_tree, allocator->size_tree) : NULL;
+        }
+        if (allocator->largest_free == block) {
+            allocator->largest_free = allocator->size_tree != NULL ? tree_max(&size_tree, allocator->size_tree) : NULL;
+        }
+    }
+    tree_remove(&address_tree, &allocator->address_tree, block);
+    atomic_fetch_sub_explicit(&allocator->available_memory, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&allocator->free_chunks, 1, memory_order_relaxed);
+}
+
+/**
+ * Description: Maps _size bytes of zeroed memory for a memory chunk, _size must be a multiple of the page size.
+ *              With MYALLOC_HUGE_PAGES the memory comes from the huge page pool if it has enough free huge pages,
+ *              and from transparent huge pages otherwise. Returns NULL if the memory can not be mapped.
+ */
+static void* map_memory(size_t _size, int _prot, int _flags) {
+    int map_flags = MAP_PRIVATE | MAP_ANONYMOUS | (_prot == PROT_NONE ? MAP_NORESERVE : 0);
+    if ((_flags & MYALLOC_HUGE_PAGES) && _size % HUGE_PAGE_SIZE == 0) {
+        void* ptr = mmap(NULL, _size, _prot, map_flags | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            return ptr;
+        }
+    }
+    if (!(_flags & (MYALLOC_HUGE_PAGES | MYALLOC_TRANSPARENT_HUGE_PAGES))) {
+        void* ptr = mmap(NULL, _size, _prot, map_flags, -1, 0);
+        return ptr == MAP_FAILED ? NULL : ptr;
+    }
+
+    // Transparent huge pages only back huge page aligned ranges, so map one more huge page and unmap the unaligned ends
+    char* ptr = mmap(NULL, _size + HUGE_PAGE_SIZE, _prot, map_flags, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    size_t head = (HUGE_PAGE_SIZE - (uintptr_t)ptr % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+    if (head != 0) {
+        munmap(ptr, head);
+    }
+    munmap(ptr + head + _size, HUGE_PAGE_SIZE - head);
+    madvise(ptr + head, _size, MADV_HUGEPAGE);
+    return ptr + head;
+}
+
+/**
+ * Description: Maps the first _size bytes of _file shared and readable and writable at a SLAB_SIZE-aligned address.
+ *              Slabs are found by masking their address, so a persistent memory chunk is mapped with the same
+ *              alignment every time. Returns NULL if the file can not be mapped.
+ */
+static void* map_file(int _file, size_t _size) {
+    char* reserved = mmap(NULL, _size + SLAB_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return NULL;
+    }
+    char* ptr = (char*)(((uintptr_t)reserved + SLAB_SIZE - 1) & ~(uintptr_t)(SLAB_SIZE - 1));
+    if (mmap(ptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, _file, 0) == MAP_FAILED) {
+        munmap(reserved, _size + SLAB_SIZE);
+        return NULL;
+    }
+    // unmap the unaligned ends of the reservation
+    if (ptr != reserved) {
+        munmap(reserved, ptr - reserved);
+    }
+    munmap(ptr + _size, reserved + SLAB_SIZE - ptr);
+    return ptr;
+}
+
+/**
+ * Description: Returns the size in bytes of a side map with one bit for each of _bits blocks or pages, in whole pages.
+ */
+static size_t side_map_size(size_t _bits, long _page_size) {
+    return ((_bits + 63) / 64 * sizeof(atomic_ullong) + _page_size - 1) / _page_size * _page_size;
+}
+
+/**
+ * Description: Sets the bits of a Linux CPU or node list such as "0-3,8-11" read from the file at _path in _mask,
+ *              a bitmap of _bits bits. Returns the highest number in the list + 1, 0 if the file can not be read.
+ */
+static int read_id_list(const char* _path, unsigned long* _mask, int _bits) {
+    FILE* file = fopen(_path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    int end = 0;
+    int first = 0;
+    int last = 0;
+    char separator = ',';
+    while (separator == ',' && fscanf(file, "%d", &first) == 1) {
+        last = first;
+        if (fscanf(file, "%c", &separator) == 1 && separator == '-') {
+            if (fscanf(file, "%d", &last) != 1 || fscanf(file, "%c", &separator) != 1) {
+                separator = '\n';
+            }
+        }
+        for (int id = first; id <= last && id < _bits && _mask != NULL; id++) {
+            _mask[id / (8 * sizeof(unsigned long))] |= 1ul << (id % (8 * sizeof(unsigned long)));
+        }
+        end = last + 1;
+    }
+    fclose(file);
+    return end;
+}
+
+/**
+ * Description: Returns the number of NUMA nodes of the system, 1 if it has no NUMA topology.
+ */
+int myalloc_numa_nodes() {
+    int nodes = read_id_list("/sys/devices/system/node/possible", NULL, 0);
+    if (nodes < 1) {
+        return 1;
+    }
+    return nodes < MYALLOC_MAX_NUMA_NODES ? nodes : MYALLOC_MAX_NUMA_NODES;
+}
+
+/**
+ * Description: Returns the NUMA node the calling thread runs on. The node is looked up again every 256 calls, so a
+ *              thread that moves to another node is noticed after a while.
+ */
+int myalloc_numa_node() {
+    if (numa_node_countdown == 0) {
+        unsigned cpu = 0;
+        unsigned node = 0;
+        numa_node = syscall(SYS_getcpu, &cpu, &node, NULL) == 0 ? (int)node : 0;
+        numa_node_countdown = NUMA_NODE_REFRESH;
+    }
+    numa_node_countdown--;
+    return numa_node;
+}
+
+// Memory chunk for prefault_thread() to pre-fault on a NUMA node
+struct prefault_job {
+    void* ptr;
+    size_t size;
+    int node;
+};
+
+/**
+ * Description: Moves the calling thread to the CPUs of the job's node and pre-faults the job's memory from there,
+ *              so memory that is not bound to the node is still placed on it by first touch.
+ */
+static void* prefault_thread(void* _job) {
+    struct prefault_job *job = _job;
+    char path[64];
+    unsigned long cpus[NUMA_MAX_CPUS / (8 * sizeof(unsigned long))] = {0};
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", job->node);
+    if (read_id_list(path, cpus, NUMA_MAX_CPUS) > 0) {
+        // pid 0 is the calling thread, if it can not be moved the memory is pre-faulted wherever it runs
+        syscall(SYS_sched_setaffinity, 0, sizeof(cpus), cpus);
+    }
+    memset(job->ptr, 0, job->size);
+    return NULL;
+}
+
+/**
+ * Description: Binds the _size bytes of mmap'd memory at _ptr to NUMA node _node and pre-faults the first
+ *              _prefault_size bytes of it from a thread on the node. A failed binding is ignored (a system without
+ *              NUMA support or a sandbox without mbind()), first touch on the node places the pages instead.
+ */
+static void bind_memory(void* _ptr, size_t _size, size_t _prefault_size, int _node) {
+    unsigned long nodes[MYALLOC_MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = {0};
+    nodes[_node / (8 * sizeof(unsigned long))] = 1ul << (_node % (8 * sizeof(unsigned long)));
+    // the kernel reads one bit less than maxnode
+    syscall(SYS_mbind, _ptr, _size, NUMA_MPOL_BIND, nodes, MYALLOC_MAX_NUMA_NODES + 1, 0);
+    if (_prefault_size == 0) {
+        return;
+    }
+
+    struct prefault_job job = { .ptr = _ptr, .size = _prefault_size, .node = _node };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, prefault_thread, &job) != 0) {
+        memset(_ptr, 0, _prefault_size);
+        return;
+    }
+    pthread_join(thread, NULL);
+}
+
+/**
+ * Description: Initializes the lock of allocator. The lock of an allocator in a file or shared memory object (_mapped)
+ *              can be locked by every process that maps it.
+ */
+static void init_lock(struct Myalloc *allocator, bool _mapped) {
+    pthread_mutexattr_t lock_attr;
+    pthread_mutexattr_init(&lock_attr);
+    if (_mapped) {
+        pthread_mutexattr_setpshared(&lock_attr, PTHREAD_PROCESS_SHARED);
+    }
+    pthread_mutex_init(&allocator->lock, &lock_attr);
+    pthread_mutexattr_destroy(&lock_attr);
+}
+
+/**
+ * Description: Same as myalloc_create(). When _file is not -1 the allocator, its memory chunk and its side maps are
+ *              a shared mapping of _file instead, which must be an empty file (see myalloc_open()).
+ */
+static struct Myalloc* create_allocator(size_t _size, enum allocation_algorithm _aalgorithm, int _flags, int _file) {
+    assert(_size > 0);
+    int min_alignment = ALIGNMENT;
+    if ((_flags >> 8) & 0xff) {
+        min_alignment = 1 << ((_flags >> 8) & 0xff);
+    }
+    if (min_alignment < ALIGNMENT || min_alignment > MAX_MIN_ALIGNMENT) {
+        return NULL;
+    }
+    int node = ((_flags >> 16) & 0xff) - 1;
+    if (node >= MYALLOC_MAX_NUMA_NODES) {
+        return NULL;
+    }
+
+    // Calculate the rounded size (nearest 64-byte boundary)
+    size_t rounded_size = ((_size + 63) / 64) * 64;
+    // the whole chunk with its tags has to be a multiple of min_alignment
+    rounded_size = ((rounded_size + FOOTER_SIZE + HEADER_SIZE + min_alignment - 1) & ~(size_t)(min_alignment - 1)) - FOOTER_SIZE - HEADER_SIZE;
+    // Allocate the memory chunk with space for its boundary tags and the prologue/epilogue tags
+    //      - the prologue footer and epilogue header are marked allocated so coalescing stops at the ends
+    //      - the allocator itself is kept in front of the prologue
+    //      - min_alignment more bytes leave room to align the start of the memory chunk
+    size_t total_size = ALLOCATOR_SIZE + min_alignment + FOOTER_SIZE + HEADER_SIZE + rounded_size + FOOTER_SIZE + HEADER_SIZE;
+    size_t reserved_size = 0;
+    long page_size = sysconf(_SC_PAGESIZE);
+    void* ptr = NULL;
+    if (_flags & MYALLOC_GROWABLE) {
+        // Reserve address space for the largest memory chunk and only make the start of it accessible,
+        // so the memory chunk can grow in place without moving allocated chunks
+        //      - the rest of the last page is added to the memory chunk
+        //      - growing and trimming work on single pages, so huge pages are always transparent huge pages
+        total_size = (total_size + page_size - 1) / page_size * page_size;
+        reserved_size = ALLOCATOR_SIZE + min_alignment + FOOTER_SIZE + HEADER_SIZE + MYALLOC_MAX_SIZE + FOOTER_SIZE + HEADER_SIZE;
+        reserved_size = (reserved_size + page_size - 1) / page_size * page_size;
+        if (total_size > reserved_size) {
+            return NULL;
+        }
+        int map_flags = _flags;
+        if (map_flags & MYALLOC_HUGE_PAGES) {
+            map_flags = (map_flags & ~MYALLOC_HUGE_PAGES) | MYALLOC_TRANSPARENT_HUGE_PAGES;
+        }
+        ptr = map_memory(reserved_size, PROT_NONE, map_flags);
+        if (ptr == NULL) {
+            return NULL;
+        }
+        if (mprotect(ptr, total_size, PROT_READ | PROT_WRITE) != 0) {
+            munmap(ptr, reserved_size);
+            return NULL;
+        }
+    } else if (_file != -1) {
+        // The side maps follow the memory chunk in the file, sized for the largest memory chunk that fits the pages
+        total_size = (total_size + page_size - 1) / page_size * page_size;
+        reserved_size = total_size + side_map_size(total_size / ALIGNMENT + 1, page_size) +
+                        side_map_size(total_size / SLAB_SIZE + 1, page_size);
+#ifdef MYALLOC_TRACE
+        // every process of a shared allocator writes to the same trace ring
+        reserved_size += (sizeof(struct trace_ring) + page_size - 1) / page_size * page_size;
+#endif
+        if (ftruncate(_file, reserved_size) != 0) {
+            return NULL;
+        }
+        // the file is zeroed by ftruncate, its pages are read in when they are first touched
+        ptr = map_file(_file, reserved_size);
+        if (ptr == NULL) {
+            return NULL;
+        }
+    } else if ((_flags & (MYALLOC_LAZY_FAULT | MYALLOC_HUGE_PAGES | MYALLOC_TRANSPARENT_HUGE_PAGES)) || node >= 0) {
+        // mmap'd memory is already zeroed and only faulted in when it is first touched
+        //      - only whole mappings can be bound to a NUMA node
+        size_t map_size = (_flags & (MYALLOC_HUGE_PAGES | MYALLOC_TRANSPARENT_HUGE_PAGES)) ? HUGE_PAGE_SIZE : page_size;
+        reserved_size = (total_size + map_size - 1) / map_size * map_size;
+        ptr = map_memory(reserved_size, PROT_READ | PROT_WRITE, _flags);
+        if (ptr == NULL) {
+            return NULL;
+        }
+    } else {
+        ptr = malloc(total_size);
+        if (ptr == NULL) {
+            return NULL;
+        }
+    }
+    if (node >= 0) {
+        // the memory a growable allocator grows into later is bound to the node as well
+        bind_memory(ptr, reserved_size, (_flags & MYALLOC_LAZY_FAULT) ? 0 : total_size, node);
+    } else if (!(_flags & MYALLOC_LAZY_FAULT) && _file == -1) {
+        // Pre-fault the memory chunk and initialize to 0
+        memset(ptr, 0, total_size);
+    }
+
+    // Points to the memory chunk after the allocator, the prologue and the header
+    void* memory = (void*)(((uintptr_t)ptr + ALLOCATOR_SIZE + FOOTER_SIZE + HEADER_SIZE + min_alignment - 1) & ~(uintptr_t)(min_alignment - 1));
+    if (_flags & MYALLOC_GROWABLE) {
+        // the memory chunk ends at the end of the accessible pages
+        rounded_size = (char*)ptr + total_size - (char*)memory - FOOTER_SIZE - HEADER_SIZE;
+    }
+
+    struct Myalloc *allocator = ptr;
+    allocator->aalgorithm = _aalgorithm;
+    allocator->flags = _flags;
+    allocator->size = rounded_size;
+    allocator->thread_caches = NULL;
+    allocator->reserved_size = reserved_size;
+    allocator->initial_size = rounded_size;
+    allocator->page_size = page_size;
+    allocator->min_alignment = min_alignment;
+    allocator->compact_cursor = NULL;
+    allocator->handles = NULL;
+    allocator->handle_capacity = 0;
+    allocator->first_free_handle = -1;
+    for (int c = 0; c < SLAB_NUM_CLASSES; c++) {
+        allocator->slabs[c] = NULL;
+    }
+    allocator->slab_pagemap = NULL;
+    atomic_init(&allocator->deferred_frees, NULL);
+    atomic_init(&allocator->owner, &thread_marker);
+#ifdef MYALLOC_TRACE
+    atomic_init(&allocator->trace_period, 0);
+    atomic_init(&allocator->trace_fn, NULL);
+    atomic_init(&allocator->trace_arg, NULL);
+    allocator->trace_ring = NULL;
+#endif
+#ifdef MYALLOC_HARDENED
+    for (int i = 0; i < QUARANTINE_SIZE; i++) {
+        allocator->quarantine[i] = NULL;
+    }
+#endif
+    allocator->slab_base = (uintptr_t)memory & ~(uintptr_t)(SLAB_SIZE - 1);
+    allocator->slab_pages = 0;
+    allocator->block_map = NULL;
+    allocator->block_map_size = 0;
+    allocator->magic = _file != -1 ? PERSISTENT_MAGIC : 0;
+    allocator->layout_size = sizeof(struct Myalloc);
+    allocator->mapped_at = allocator;
+    allocator->in_use = true;
+    allocator->shared = false;
+    allocator->root = NULL;
+    allocator->file = -1;
+
+    init_lock(allocator, _file != -1);
+
+    void* prologue = (char*)memory - HEADER_SIZE - FOOTER_SIZE;
+    allocator->memory = memory;
+    *((size_t*)prologue) = BLOCK_ALLOCATED;                                                             // prologue footer
+    set_tags(allocator->memory, allocator->size, 0);                                                    // one free chunk
+    *((size_t*)((char*)allocator->memory + allocator->size + FOOTER_SIZE)) = BLOCK_ALLOCATED;           // epilogue header
+
+    // Initialize the free list with the whole chunk
+    atomic_init(&allocator->available_memory, 0);
+    atomic_init(&allocator->free_chunks, 0);
+    allocator->size_tree = NULL;
+    allocator->smallest_free = NULL;
+    allocator->largest_free = NULL;
+    allocator->bin_bitmap = 0;
+    allocator->address_tree = NULL;
+    free_list_insert(allocator, allocator->memory);
+
+    // Store statistics information
+    atomic_init(&allocator->used_memory, 0);
+    atomic_init(&allocator->allocated_chunks, 0);
+
+    // The side maps have one bit for every block or page a growable memory chunk can grow into
+    char* end = reserved_size != 0 && _file == -1 ? (char*)ptr + reserved_size : (char*)memory + rounded_size + FOOTER_SIZE + HEADER_SIZE;
+    size_t blocks = ((char*)end - (char*)memory) / ALIGNMENT + 1;
+    size_t pages = ((uintptr_t)end - allocator->slab_base) / SLAB_SIZE + 1;
+    allocator->block_map_size = side_map_size(blocks, page_size);
+    if (_file != -1) {
+        // a persistent allocator keeps its side maps in the file after the memory chunk
+        allocator->block_map = (atomic_ullong*)((char*)ptr + total_size);
+        if (_flags & MYALLOC_SLABS) {
+            allocator->slab_pagemap = (atomic_ullong*)((char*)allocator->block_map + side_map_size(total_size / ALIGNMENT + 1, page_size));
+            allocator->slab_pages = pages;
+        }
+    } else {
+        allocator->block_map = mmap(NULL, allocator->block_map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (allocator->block_map == MAP_FAILED) {
+            allocator->block_map = NULL;
+            myalloc_destroy(allocator);
+            return NULL;
+        }
+        if (_flags & MYALLOC_SLABS) {
+            allocator->slab_pagemap = calloc((pages + 63) / 64, sizeof(atomic_ullong));
+            if (allocator->slab_pagemap == NULL) {
+                myalloc_destroy(allocator);
+                return NULL;
+            }
+            allocator->slab_pages = pages;
+        }
+    }
+#ifdef MYALLOC_TRACE
+    if (_file != -1) {
+        // the trace ring is the last part of the file
+        allocator->trace_ring = (struct trace_ring*)((char*)ptr + reserved_size - (sizeof(struct trace_ring) + page_size - 1) / page_size * page_size);
+    } else {
+        allocator->trace_ring = calloc(1, sizeof(struct trace_ring));
+        if (allocator->trace_ring == NULL) {
+            myalloc_destroy(allocator);
+            return NULL;
+        }
+    }
+    for (size_t i = 0; i < TRACE_RING_SIZE; i++) {
+        atomic_init(&allocator->trace_ring->slots[i].sequence, i);
+    }
+#endif
+    return allocator;
+}
+
+/**
+ * Description: Creates an allocator serving requests from its own memory chunk of _size bytes, rounded up to the
+ *              nearest next 64-byte boundary like initialize_allocator(). Each allocator has its own lock, free lists,
+ *              statistics and thread caches, so allocators can be used at the same time without contending.
+ *              _flags is a combination of enum allocator_flags.
+ *              Returns NULL if the memory chunk can not be allocated.
+ */
+struct Myalloc* myalloc_create(size_t _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    return create_allocator(_size, _aalgorithm, _flags, -1);
+}
+
+/**
+ * Description: Returns _ptr moved by _delta bytes, NULL stays NULL.
+ */
+static void* relocate(void* _ptr, ptrdiff_t _delta) {
+    return _ptr == NULL ? NULL : (char*)_ptr + _delta;
+}
+
+/**
+ * Description: Maps the persistent allocator of the _file_size bytes of _file, which was closed by myalloc_destroy().
+ *              The links inside the memory chunk are relative, so only the pointers of the allocator itself are
+ *              moved to the new address, and the state that belongs to the process is set up again.
+ *              Returns NULL if the file does not hold an allocator of this build or was not closed cleanly.
+ */
+static struct Myalloc* reopen_allocator(int _file, size_t _file_size) {
+    struct Myalloc header;
+    if (pread(_file, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != PERSISTENT_MAGIC ||
+        header.layout_size != sizeof(struct Myalloc) || header.reserved_size != _file_size || header.shared) {
+        report_error("Error: the file does not hold a memory chunk of this allocator.\n");
+        return NULL;
+    }
+    if (header.in_use) {
+        report_error("Error: the memory chunk in the file is in use or was not closed cleanly.\n");
+        return NULL;
+    }
+    struct Myalloc *allocator = map_file(_file, _file_size);
+    if (allocator == NULL) {
+        return NULL;
+    }
+
+    ptrdiff_t delta = (char*)allocator - (char*)allocator->mapped_at;
+    allocator->memory = relocate(allocator->memory, delta);
+    allocator->size_tree = relocate(allocator->size_tree, delta);
+    allocator->smallest_free = relocate(allocator->smallest_free, delta);
+    allocator->largest_free = relocate(allocator->largest_free, delta);
+    for (int k = 0; k < NUM_SIZE_CLASSES; k++) {
+        allocator->bins[k] = relocate(allocator->bins[k], delta);
+    }
+    allocator->address_tree = relocate(allocator->address_tree, delta);
+    for (int c = 0; c < SLAB_NUM_CLASSES; c++) {
+        allocator->slabs[c] = relocate(allocator->slabs[c], delta);
+    }
+    allocator->slab_base += delta;
+    allocator->slab_pagemap = relocate(allocator->slab_pagemap, delta);
+    allocator->block_map = relocate(allocator->block_map, delta);
+    allocator->root = relocate(allocator->root, delta);
+    allocator->mapped_at = allocator;
+    allocator->in_use = true;
+
+    // Thread caches, handles, deferred frees and the lock only lived as long as the process that closed the file
+    allocator->thread_caches = NULL;
+    allocator->compact_cursor = NULL;
+    allocator->handles = NULL;
+    allocator->handle_capacity = 0;
+    allocator->first_free_handle = -1;
+    atomic_init(&allocator->deferred_frees, NULL);
+    atomic_init(&allocator->owner, &thread_marker);
+    allocator->file = -1;
+    init_lock(allocator, true);
+#ifdef MYALLOC_TRACE
+    atomic_init(&allocator->trace_period, 0);
+    atomic_init(&allocator->trace_fn, NULL);
+    atomic_init(&allocator->trace_arg, NULL);
+    // the events of the last process are dropped
+    allocator->trace_ring = relocate(allocator->trace_ring, delta);
+    atomic_init(&allocator->trace_ring->head, 0);
+    atomic_init(&allocator->trace_ring->tail, 0);
+    atomic_init(&allocator->trace_ring->dropped, 0);
+    for (size_t i = 0; i < TRACE_RING_SIZE; i++) {
+        atomic_init(&allocator->trace_ring->slots[i].sequence, i);
+    }
+#endif
+    return allocator;
+}
+
+/**
+ * Description: Opens the persistent allocator in the file at _path, so the blocks of a process survive a restart.
+ *              An empty or new file gets a memory chunk of _size bytes like myalloc_create(). A file written before
+ *              is mapped again with the size, algorithm and flags it was created with, _size, _aalgorithm and _flags
+ *              are ignored then. It may be mapped at another address, see set_root().
+ *              myalloc_destroy() writes the memory chunk back to the file and closes it.
+ *              MYALLOC_GROWABLE is not supported, the page fault and NUMA flags are ignored and handles can not be
+ *              allocated. Only one process can have the file open at a time.
+ *              Returns NULL if the file can not be opened or holds no allocator that was closed cleanly.
+ */
+struct Myalloc* myalloc_open(const char* _path, size_t _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    if (_flags & MYALLOC_GROWABLE) {
+        return NULL;
+    }
+    int file = open(_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (file == -1) {
+        return NULL;
+    }
+    struct stat st;
+    if (flock(file, LOCK_EX | LOCK_NB) != 0 || fstat(file, &st) != 0) {
+        close(file);
+        return NULL;
+    }
+    struct Myalloc *allocator = NULL;
+    if (st.st_size == 0) {
+        // a file mapping faults its pages in lazily and is not bound to a node
+        int flags = _flags & ~(MYALLOC_LAZY_FAULT | MYALLOC_HUGE_PAGES | MYALLOC_TRANSPARENT_HUGE_PAGES | MYALLOC_NUMA | (0xff << 16));
+        allocator = create_allocator(_size, _aalgorithm, flags, file);
+    } else {
+        allocator = reopen_allocator(file, st.st_size);
+    }
+    if (allocator == NULL) {
+        close(file);
+        return NULL;
+    }
+    allocator->file = file;
+    return allocator;
+}
+
+/**
+ * Description: Same as set_root(), for _allocator.
+ */
+void myalloc_set_root(struct Myalloc* _allocator, void* _ptr) {
+    _allocator->root = _ptr;
+}
+
+/**
+ * Description: Same as get_root(), for _allocator.
+ */
+void* myalloc_get_root(struct Myalloc* _allocator) {
+    return _allocator->root;
+}
+
+/**
+ * Description: Creates an allocator of _size bytes in the new POSIX shared memory object _name (see shm_open()), which
+ *              other processes map with myalloc_shm_attach(). Blocks allocated by any process can be freed by any
+ *              other, the allocator lock is a PTHREAD_PROCESS_SHARED mutex. Blocks are passed between processes as
+ *              offsets, see myalloc_to_offset(). MYALLOC_GROWABLE is not supported, thread caches, the page fault
+ *              and NUMA flags are ignored and handles can not be allocated.
+ *              myalloc_destroy() unmaps the allocator from the calling process, the object is removed with
+ *              shm_unlink(_name) once no other process has to attach to it.
+ *              Returns NULL if the object already exists or can not be created.
+ */
+struct Myalloc* myalloc_shm_create(const char* _name, size_t _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    if (_flags & MYALLOC_GROWABLE) {
+        return NULL;
+    }
+    int file = shm_open(_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (file == -1) {
+        return NULL;
+    }
+    // thread caches belong to one process, and shared memory is not bound to a node
+    int flags = _flags & ~(MYALLOC_THREAD_CACHE | MYALLOC_LAZY_FAULT | MYALLOC_HUGE_PAGES | MYALLOC_TRANSPARENT_HUGE_PAGES |
+                           MYALLOC_NUMA | (0xff << 16));
+    struct Myalloc *allocator = create_allocator(_size, _aalgorithm, flags, file);
+    close(file);
+    if (allocator == NULL) {
+        shm_unlink(_name);
+        return NULL;
+    }
+    allocator->shared = true;
+    return allocator;
+}
+
+/**
+ * Description: Maps the shared allocator in the shared memory object _name, created by myalloc_shm_create() in
+ *              another process. The allocator keeps pointers to its own memory, so it is mapped at the same address
+ *              in every process. Returns NULL if the object does not hold a shared allocator or that address is taken.
+ */
+struct Myalloc* myalloc_shm_attach(const char* _name) {
+    int file = shm_open(_name, O_RDWR, 0);
+    if (file == -1) {
+        return NULL;
+    }
+    struct Myalloc header;
+    struct stat st;
+    if (fstat(file, &st) != 0 || pread(file, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        header.magic != PERSISTENT_MAGIC || header.layout_size != sizeof(struct Myalloc) || !header.shared ||
+        header.reserved_size != (size_t)st.st_size) {
+        report_error("Error: %s does not hold a shared allocator.\n", _name);
+        close(file);
+        return NULL;
+    }
+    // kernels without MAP_FIXED_NOREPLACE take the address as a hint
+    void* ptr = mmap(header.mapped_at, header.reserved_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, file, 0);
+    close(file);
+    if (ptr == MAP_FAILED) {
+        report_error("Error: the address of the shared allocator is in use.\n");
+        return NULL;
+    }
+    if (ptr != header.mapped_at) {
+        report_error("Error: the address of the shared allocator is in use.\n");
+        munmap(ptr, header.reserved_size);
+        return NULL;
+    }
+    return ptr;
+}
+
+/**
+ * Description: Same as to_offset(), for a block of _allocator.
+ */
+size_t myalloc_to_offset(struct Myalloc* _allocator, void* _ptr) {
+    return (char*)_ptr - (char*)_allocator->memory;
+}
+
+/**
+ * Description: Same as from_offset(), for a block of _allocator.
+ */
+void* myalloc_from_offset(struct Myalloc* _allocator, size_t _offset) {
+    return (char*)_allocator->memory + _offset;
+}
+
+/**
+ * Description: Initialize the memory allocator. 
+ *              _size indicates the contiguous memory chunk size that is assumed for the rest of the program:
+ *                  - it should align to the nearest next 64-byte boundary (round up)
+ *                  - Ex) If the requested size is 120 bytes, internally you should round it up to 128 bytes
+ *                  - stats information should base on the actual chunk size
+ *                  - any requests for allocation and deallocation requests will be served from this contiguous chunk
+ *              You must allocate the memory chunk using malloc.
+ *              The memory chunk must be pre-faulted.
+ *              Its content initialized to 0 (using memset).
+ */
+void initialize_allocator(size_t _size, enum allocation_algorithm _aalgorithm) {
+    initialize_allocator_with_flags(_size, _aalgorithm, 0);
+}
+
+/**
+ * Description: Same as initialize_allocator(), with _flags being a combination of enum allocator_flags.
+ */
+void initialize_allocator_with_flags(size_t _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    // Without MYALLOC_NUMA the default allocator is a single arena
+    arena_count = (_flags & MYALLOC_NUMA) ? myalloc_numa_nodes() : 1;
+    for (int node = 0; node < arena_count; node++) {
+        int flags = (_flags & MYALLOC_NUMA) ? (_flags & ~MYALLOC_NUMA) | MYALLOC_NUMA_NODE(node) : _flags;
+        arenas[node] = myalloc_create(_size, _aalgorithm, flags);
+        if (arenas[node] == NULL) {
+            report_error("Error: initialize_allocator malloc failed\n");
+            exit(1);
+        }
+    }
+    // handles and the other calls that are not routed by node use the arena of the initializing thread
+    int node = myalloc_numa_node();
+    myalloc = arenas[node < arena_count ? node : 0];
+}
+
+/**
+ * Description: Same as set_owner(), for _allocator.
+ */
+void myalloc_set_owner(struct Myalloc* _allocator) {
+    atomic_store_explicit(&_allocator->owner, &thread_marker, memory_order_relaxed);
+}
+
+/**
+ * Description: Same as initialize_allocator_with_flags(), with the persistent memory chunk in the file at _path
+ *              (see myalloc_open()).
+ */
+void initialize_allocator_from_file(const char* _path, size_t _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    myalloc = myalloc_open(_path, _size, _aalgorithm, _flags);
+    if (myalloc == NULL) {
+        report_error("Error: initialize_allocator could not open %s\n", _path);
+        exit(1);
+    }
+    arenas[0] = myalloc;
+    arena_count = 1;
+}
+
+/**
+ * Description: Stores _ptr as the root block of a persistent allocator, the block the data in the memory chunk is
+ *              found from after a restart. The root is moved with the memory chunk when the file is mapped at
+ *              another address. Pointers stored inside blocks are not, so blocks should refer to each other by their
+ *              offset from the root.
+ */
+void set_root(void* _ptr) {
+    myalloc_set_root(myalloc, _ptr);
+}
+
+/**
+ * Description: Returns the root block set with set_root(), NULL if none was set.
+ */
+void* get_root() {
+    return myalloc_get_root(myalloc);
+}
+
+/**
+ * Description: Returns the offset of the block at _ptr from the start of the memory chunk. Offsets stay valid when
+ *              the memory chunk is mapped at another address, so they can be stored in blocks or sent to another
+ *              process that maps the same memory chunk.
+ */
+size_t to_offset(void* _ptr) {
+    return myalloc_to_offset(myalloc, _ptr);
+}
+
+/**
+ * Description: Returns the block at _offset from the start of the memory chunk, see to_offset().
+ */
+void* from_offset(size_t _offset) {
+    return myalloc_from_offset(myalloc, _offset);
+}
+
+/**
+ * Description: Makes the calling thread the owner of the allocator. With MYALLOC_DEFERRED_FREE, deallocate() on any
+ *              other thread pushes the block on a lock-free stack instead of taking the lock, and the stack is
+ *              returned to the free lists by the next allocation. The thread that creates an allocator owns it.
+ */
+void set_owner() {
+    for (int i = 0; i < arena_count; i++) {
+        myalloc_set_owner(arenas[i]);
+    }
+}
+
+/**
+ * Description: Returns the chunk size used for a request of _size bytes.
+ *              Requests are rounded up so the next chunk starts at a multiple of the minimum alignment
+ *              and the chunk can hold its free list links once it is freed.
+ */
+static size_t chunk_size(struct Myalloc *allocator, size_t _size) {
+    size_t alignment = allocator->min_alignment;
+    _size += CANARY_SIZE;
+    if (_size < MIN_CHUNK_SIZE) {
+        _size = MIN_CHUNK_SIZE;
+    }
+    return ((_size + FOOTER_SIZE + HEADER_SIZE + alignment - 1) & ~(alignment - 1)) - FOOTER_SIZE - HEADER_SIZE;
+}
+
+/**
+ * Description: Allocates the first _size bytes of the free chunk at ptr, which has already left the free lists,
+ *              and returns the rest of it to the free lists. flags are the bits to set in the tags of the allocated chunk.
+ *              allocator->lock must be held.
+ */
+static void split_chunk(struct Myalloc *allocator, void* ptr, size_t _size, size_t flags) {
+    // Update the free list
+    //  - if there is space left in the free chunk for a new header, footer and payload, split it off
+    //  - if the whole chunk was used, it just leaves the free list
+    size_t ptr_free_size = BLOCK_SIZE(ptr);
+    size_t leftover_free_space = ptr_free_size - _size;
+    if (leftover_free_space >= HEADER_SIZE + FOOTER_SIZE + MIN_CHUNK_SIZE) {
+        // adjust tags for the allocated chunk
+            // new_size = _size;
+        set_tags(ptr, _size, flags);
+        // the rest of the chunk becomes a new free chunk
+            // new_address = old_address + _size + FOOTER_SIZE + HEADER_SIZE
+            // new_size = old_size - _size - FOOTER_SIZE - HEADER_SIZE
+        void* chunk_free = next_block(ptr);
+        set_tags(chunk_free, leftover_free_space - FOOTER_SIZE - HEADER_SIZE, 0);
+        free_list_insert(allocator, chunk_free);
+    } else {
+        // size stays the same since we are allocating the whole free chunk
+        set_tags(ptr, ptr_free_size, flags);
+    }
+    block_map_set(allocator, ptr, true);
+    atomic_fetch_add_explicit(&allocator->used_memory, BLOCK_SIZE(ptr), memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocator->allocated_chunks, 1, memory_order_relaxed);
+}
+
+/**
+ * Description: Returns the free chunk the allocation algorithm picks for _size bytes without taking it off the
+ *              free lists, or NULL if no free chunk is large enough. allocator->lock must be held.
+ */
+static void* find_free_chunk(struct Myalloc *allocator, size_t _size) {
+    void* ptr = NULL;
+    // Find the appropriate chunk from the free chunk indexes
+    switch(allocator->aalgorithm) {
+        // Use the first hole in address order that is big enough
+        case FIRST_FIT: {
+            ptr = address_first_fit(allocator, _size);
+            break;
+        }
+        // Use the smallest hole that is big enough, the first chunk of the size tree not smaller than _size
+        case BEST_FIT: {
+            ptr = size_lower_bound(allocator, _size);
+            break;
+        }
+        // Use the largest hole if it is big enough
+        case WORST_FIT: {
+            if (allocator->largest_free != NULL && BLOCK_SIZE(allocator->largest_free) >= _size) {
+                ptr = allocator->largest_free;
+            }
+            break;
+        }
+        // Use the best of the first SEGREGATED_SEARCH_LIMIT chunks of the bin of _size that fit, or else the head of
+        // the first non-empty higher bin
+        //      - only the bin of _size itself can contain chunks that are too small, every chunk of a higher bin fits
+        //      - both take constant time however many chunks the bins hold
+        case SEGREGATED_FIT: {
+            int k = size_class(_size);
+            void* curr = allocator->bins[k];
+            for (int i = 0; curr != NULL && i < SEGREGATED_SEARCH_LIMIT; i++) {
+                size_t curr_free_size = BLOCK_SIZE(curr);
+                if (curr_free_size >= _size && (ptr == NULL || curr_free_size < BLOCK_SIZE(ptr))) {
+                    ptr = curr;
+                }
+                curr = link_get(&FREE_LINKS(curr)->next);
+            }
+            unsigned long long higher = k + 1 < NUM_SIZE_CLASSES ? allocator->bin_bitmap & (~0ull << (k + 1)) : 0;
+            if (ptr == NULL && higher != 0) {
+                ptr = allocator->bins[__builtin_ctzll(higher)];
+            }
+            break;
+        }
+        default: {
+            assert(!"unknown allocation algorithm");
+            break;
+        }
+    }
+    return ptr;
+}
+
+/**
+ * Description: Finds a free chunk for _size bytes (already rounded by chunk_size()) and splits it.
+ *              Returns NULL if no free chunk is large enough. allocator->lock must be held.
+ */
+static void* allocate_chunk(struct Myalloc *allocator, size_t _size) {
+    void* ptr = find_free_chunk(allocator, _size);
+    if (ptr != NULL) {  // we found a sufficient chunk
+        free_list_remove(allocator, ptr);
+        split_chunk(allocator, ptr, _size, BLOCK_ALLOCATED);
+    }
+
+    return ptr;
+}
+
+/**
+ * Description: Returns the address of the first block in the free chunk at block that is aligned to _alignment and
+ *              leaves room for a free chunk in front of it, or block itself if it is aligned already.
+ */
+static char* aligned_block(void* block, size_t _alignment) {
+    // the space in front of the aligned address must be empty or hold a free chunk of its own
+    uintptr_t start = (uintptr_t)block;
+    uintptr_t aligned = (start + _alignment - 1) & ~(uintptr_t)(_alignment - 1);
+    while (aligned != start && aligned - start < HEADER_SIZE + FOOTER_SIZE + MIN_CHUNK_SIZE) {
+        aligned += _alignment;
+    }
+    return (char*)aligned;
+}
+
+/**
+ * Description: Returns the free chunk with the lowest address in the address subtree at root that holds _size bytes
+ *              at an address aligned to _alignment, or NULL if there is none. Subtrees whose largest chunk is too small
+ *              are skipped. allocator->lock must be held.
+ */
+static void* address_aligned_fit(void* root, size_t _size, size_t _alignment) {
+    if (root == NULL || ADDRESS_NODE(root)->max_size < _size) {
+        return NULL;
+    }
+    void* ptr = address_aligned_fit(tree_left(&address_tree, root), _size, _alignment);
+    if (ptr == NULL) {
+        if (aligned_block(root, _alignment) + _size <= (char*)root + BLOCK_SIZE(root)) {
+            ptr = root;
+        } else {
+            ptr = address_aligned_fit(tree_right(&address_tree, root), _size, _alignment);
+        }
+    }
+    return ptr;
+}
+
+/**
+ * Description: Finds a free chunk holding _size bytes (already rounded by chunk_size()) at an address aligned to
+ *              _alignment, which is a power of two larger than the minimum alignment, and splits it.
+ *              The free space in front of the aligned address stays a free chunk, so it is not wasted.
+ *              Returns NULL if no free chunk is large enough. allocator->lock must be held.
+ */
+static void* allocate_aligned_chunk(struct Myalloc *allocator, size_t _size, size_t _alignment) {
+    // Any chunk with room for the padding in front of the aligned address fits, so the allocation algorithm picks
+    // one of those first. Only when there is none are the smaller chunks checked, in address order.
+    void* ptr = find_free_chunk(allocator, _size + _alignment + HEADER_SIZE + FOOTER_SIZE + MIN_CHUNK_SIZE);
+    if (ptr == NULL) {
+        ptr = address_aligned_fit(allocator->address_tree, _size, _alignment);
+    }
+    if (ptr == NULL) {
+        return NULL;
+    }
+
+    char* aligned = aligned_block(ptr, _alignment);
+    free_list_remove(allocator, ptr);
+    size_t free_size = BLOCK_SIZE(ptr);
+    if (aligned != (char*)ptr) {
+        // the padding becomes a free chunk ending right before the header of the aligned chunk
+        size_t padding = aligned - (char*)ptr;
+        set_tags(ptr, padding - FOOTER_SIZE - HEADER_SIZE, 0);
+        free_list_insert(allocator, ptr);
+        free_size -= padding;
+    }
+    set_tags(aligned, free_size, 0);
+    split_chunk(allocator, aligned, _size, BLOCK_ALLOCATED | BLOCK_FIXED);
+    return aligned;
+}
+
+/**
+ * Description: Returns the allocated chunk at _ptr to the free lists, merging it with its free neighbours.
+ *              allocator->lock must be held.
+ */
+static void deallocate_chunk(struct Myalloc *allocator, void* _ptr) {
+    // Merge with the physical neighbours found through the boundary tags
+    //      - the right neighbour starts right after our footer
+    //      - the left neighbour's footer sits right before our header
+    void* block = _ptr;
+    size_t block_size = BLOCK_SIZE(_ptr);
+    block_map_set(allocator, _ptr, false);
+    atomic_fetch_sub_explicit(&allocator->used_memory, block_size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&allocator->allocated_chunks, 1, memory_order_relaxed);
+    void* right = next_block(_ptr);
+    if (!is_allocated(right)) {
+        // new_size = size(_ptr) + FOOTER_SIZE + HEADER_SIZE + size(right)
+        free_list_remove(allocator, right);
+        if (allocator->compact_cursor == right) {
+            allocator->compact_cursor = _ptr;
+        }
+        block_size += FOOTER_SIZE + HEADER_SIZE + BLOCK_SIZE(right);
+    }
+    void* left = prev_free_block(_ptr);
+    if (left != NULL) {
+        // left is the new address: new_size = size(left) + FOOTER_SIZE + HEADER_SIZE + new_size
+        free_list_remove(allocator, left);
+        if (allocator->compact_cursor == _ptr) {
+            allocator->compact_cursor = left;
+        }
+        block_size += BLOCK_SIZE(left) + FOOTER_SIZE + HEADER_SIZE;
+        block = left;
+    }
+    set_tags(block, block_size, 0);
+
+    // insert the chunk at the head of the free list
+    free_list_insert(allocator, block);
+}
+
+#ifdef MYALLOC_HARDENED
+/**
+ * Description: Returns the next number of the calling thread's random generator.
+ */
+static unsigned random_next() {
+    if (random_state == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        random_state = ((uint64_t)now.tv_nsec << 32) ^ (uintptr_t)&random_state ^ (uint64_t)now.tv_sec;
+        random_state |= 1;
+    }
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (unsigned)(random_state >> 32);
+}
+
+/**
+ * Description: Returns the quarantined chunk at _ptr to the free lists after checking that nothing wrote to it.
+ *              allocator->lock must be held.
+ */
+static void release_quarantined_chunk(struct Myalloc *allocator, void* _ptr) {
+    if (*(size_t*)_ptr != FREED_POISON) {
+        heap_corruption("write to a freed block", _ptr);
+    }
+    check_chunk(_ptr);
+    deallocate_chunk(allocator, _ptr);
+}
+#endif
+
+/**
+ * Description: Puts the allocated chunk at _ptr, which has already left the block map, into a random entry of the
+ *              quarantine of allocator and returns the chunk that was there to the free lists, so a freed chunk is
+ *              not reused before up to QUARANTINE_SIZE later frees and not in a predictable order.
+ *              Returns false if the chunk is not quarantined: it is too large or the build is not MYALLOC_HARDENED.
+ *              allocator->lock must be held.
+ */
+static bool quarantine_chunk(struct Myalloc *allocator, void* _ptr) {
+#ifdef MYALLOC_HARDENED
+    if (BLOCK_SIZE(_ptr) > QUARANTINE_MAX_SIZE) {
+        return false;
+    }
+    *(size_t*)_ptr = FREED_POISON;
+    unsigned i = random_next() % QUARANTINE_SIZE;
+    void* evicted = allocator->quarantine[i];
+    allocator->quarantine[i] = _ptr;
+    if (evicted != NULL) {
+        release_quarantined_chunk(allocator, evicted);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Description: Returns every quarantined chunk of allocator to the free lists. Returns true if there was one, so a
+ *              failed search of the free lists is worth repeating. allocator->lock must be held.
+ */
+static bool flush_quarantine(struct Myalloc *allocator) {
+    bool flushed = false;
+#ifdef MYALLOC_HARDENED
+    for (int i = 0; i < QUARANTINE_SIZE; i++) {
+        if (allocator->quarantine[i] != NULL) {
+            release_quarantined_chunk(allocator, allocator->quarantine[i]);
+            allocator->quarantine[i] = NULL;
+            flushed = true;
+        }
+    }
+#endif
+    return flushed;
+}
+
+/**
+ * Description: Returns the epilogue of the memory chunk, the block whose header marks the end of the memory chunk.
+ */
+static void* epilogue_block(struct Myalloc *allocator) {
+    return (char*)allocator->memory + allocator->size + FOOTER_SIZE + HEADER_SIZE;
+}
+
+/**
+ * Description: Makes the memory chunk of a growable allocator large enough for a free chunk of _size bytes at its end.
+ *              The new memory is merged with the last chunk if that one is free.
+ *              Returns false if the allocator is not growable or its reserved address space is used up.
+ *              Quarantined chunks are returned to the free lists first, so an allocator that is not growable returns
+ *              true when there were any and the caller searches the free lists again. allocator->lock must be held.
+ */
+static bool grow_memory(struct Myalloc *allocator, size_t _size) {
+    bool flushed = flush_quarantine(allocator);
+    if (!(allocator->flags & MYALLOC_GROWABLE)) {
+        return flushed;
+    }
+    // The old epilogue becomes the header of the new chunk and the new epilogue goes at the end of the new memory
+    //      - the new chunk holds grow_size - FOOTER_SIZE - HEADER_SIZE bytes on its own
+    //      - merged with a free last chunk it holds size(last) + grow_size bytes
+    void* block = epilogue_block(allocator);
+    void* last = prev_free_block(block);
+    size_t needed = _size + FOOTER_SIZE + HEADER_SIZE;
+    if (last != NULL) {
+        needed = _size > BLOCK_SIZE(last) ? _size - BLOCK_SIZE(last) : 0;
+    }
+    if (needed < GROW_SEGMENT_SIZE) {
+        needed = GROW_SEGMENT_SIZE;
+    }
+    size_t grow_size = (needed + allocator->page_size - 1) / allocator->page_size * allocator->page_size;
+    size_t used_size = (char*)block - (char*)allocator;
+    if (needed > allocator->reserved_size || grow_size > allocator->reserved_size - used_size) {
+        return flushed;
+    }
+    if (mprotect(block, grow_size, PROT_READ | PROT_WRITE) != 0) {
+        return flushed;
+    }
+    allocator->size += grow_size;
+
+    size_t block_size = grow_size - FOOTER_SIZE - HEADER_SIZE;
+    if (last != NULL) {
+        free_list_remove(allocator, last);
+        block_size += BLOCK_SIZE(last) + FOOTER_SIZE + HEADER_SIZE;
+        block = last;
+    }
+    set_tags(block, block_size, 0);
+    free_list_insert(allocator, block);
+    *((size_t*)((char*)epilogue_block(allocator) - HEADER_SIZE)) = BLOCK_ALLOCATED;
+    return true;
+}
+
+/**
+ * Description: Gives the pages at the end of a growable allocator's memory chunk back to the system when they are
+ *              part of a free last chunk, keeping GROW_SEGMENT_SIZE bytes of it so a few allocations and deallocations
+ *              at the end do not map and unmap the same pages. The memory chunk never shrinks below its initial size.
+ *              allocator->lock must be held.
+ */
+static void trim_memory(struct Myalloc *allocator) {
+    if (!(allocator->flags & MYALLOC_GROWABLE)) {
+        return;
+    }
+    void* end = epilogue_block(allocator);
+    void* last = prev_free_block(end);
+    if (last == NULL || BLOCK_SIZE(last) < 2 * GROW_SEGMENT_SIZE) {
+        return;
+    }
+    size_t trim_size = (BLOCK_SIZE(last) - GROW_SEGMENT_SIZE) / allocator->page_size * allocator->page_size;
+    if (trim_size > allocator->size - allocator->initial_size) {
+        trim_size = allocator->size - allocator->initial_size;
+    }
+    if (trim_size == 0) {
+        return;
+    }
+
+    // the last chunk keeps its position and shrinks by trim_size, the epilogue moves back by trim_size
+    free_list_remove(allocator, last);
+    set_tags(last, BLOCK_SIZE(last) - trim_size, 0);
+    free_list_insert(allocator, last);
+    allocator->size -= trim_size;
+    void* new_end = epilogue_block(allocator);
+    *((size_t*)((char*)new_end - HEADER_SIZE)) = BLOCK_ALLOCATED;
+    madvise(new_end, trim_size, MADV_DONTNEED);
+    mprotect(new_end, trim_size, PROT_NONE);
+}
+
+/**
+ * Description: Moves up to n chunks of size class c from the cache back to the shared free lists.
+ *              The cache lock must be held.
+ */
+static void tcache_flush(struct thread_cache *cache, int c, int n) {
+    pthread_mutex_lock(&cache->allocator->lock);
+    while (n > 0 && cache->count[c] > 0) {
+        void* chunk = cache->chunks[c][--cache->count[c]];
+#ifdef MYALLOC_HARDENED
+        if (*(size_t*)chunk != FREED_POISON) {
+            heap_corruption("write to a freed block", chunk);
+        }
+#endif
+        deallocate_chunk(cache->allocator, chunk);
+        n--;
+    }
+    trim_memory(cache->allocator);
+    pthread_mutex_unlock(&cache->allocator->lock);
+}
+
+/**
+ * Description: Moves every chunk in the cache back to the shared free lists. The cache lock must be held.
+ */
+static void tcache_flush_all(struct thread_cache *cache) {
+    for (int c = 0; c < TCACHE_NUM_CLASSES; c++) {
+        if (cache->count[c] > 0) {
+            tcache_flush(cache, c, cache->count[c]);
+        }
+    }
+}
+
+/**
+ * Description: Unlinks the cache from the caches of its allocator. tcache_registry_lock and the cache lock must be held.
+ */
+static void tcache_unregister(struct thread_cache *cache) {
+    struct thread_cache **curr = &cache->allocator->thread_caches;
+    while (*curr != NULL && *curr != cache) {
+        curr = &(*curr)->next;
+    }
+    if (*curr != NULL) {
+        *curr = cache->next;
+    }
+    cache->next = NULL;
+    cache->registered = false;
+}
+
+/**
+ * Description: Thread exit handler, returns the chunks of the exiting thread's caches to the shared free lists.
+ */
+static void tcache_thread_exit(void* _caches) {
+    struct thread_cache *caches = _caches;
+    pthread_mutex_lock(&tcache_registry_lock);
+    for (int i = 0; i < TCACHE_SLOTS; i++) {
+        pthread_mutex_lock(&caches[i].lock);
+        if (caches[i].registered) {
+            tcache_flush_all(&caches[i]);
+            tcache_unregister(&caches[i]);
+        }
+        pthread_mutex_unlock(&caches[i].lock);
+    }
+    pthread_mutex_unlock(&tcache_registry_lock);
+}
+
+static void tcache_key_create() {
+    pthread_key_create(&tcache_key, tcache_thread_exit);
+}
+
+/**
+ * Description: Returns the calling thread's cache for allocator with its lock held, registering it on first use.
+ *              Returns NULL if the thread already has caches for TCACHE_SLOTS other allocators.
+ */
+static struct thread_cache* tcache_acquire(struct Myalloc *allocator) {
+    struct thread_cache *cache = NULL;
+    for (int i = 0; i < TCACHE_SLOTS && cache == NULL; i++) {
+        if (tcache[i].allocator == allocator) {
+            cache = &tcache[i];
+        }
+    }
+    if (cache != NULL) {
+        pthread_mutex_lock(&cache->lock);
+        if (cache->registered) {
+            return cache;
+        }
+        pthread_mutex_unlock(&cache->lock);
+    } else {
+        // take a slot that is unused or whose allocator has been destroyed
+        for (int i = 0; i < TCACHE_SLOTS && cache == NULL; i++) {
+            pthread_mutex_lock(&tcache[i].lock);
+            if (!tcache[i].registered) {
+                cache = &tcache[i];
+            }
+            pthread_mutex_unlock(&tcache[i].lock);
+        }
+        if (cache == NULL) {
+            return NULL;
+        }
+    }
+
+    // registering needs the registry lock, which comes before the cache lock
+    pthread_once(&tcache_key_once, tcache_key_create);
+    pthread_mutex_lock(&tcache_registry_lock);
+    pthread_mutex_lock(&cache->lock);
+    memset(cache->count, 0, sizeof(cache->count));
+    cache->allocator = allocator;
+    cache->next = allocator->thread_caches;
+    allocator->thread_caches = cache;
+    cache->registered = true;
+    pthread_mutex_unlock(&tcache_registry_lock);
+    pthread_setspecific(tcache_key, tcache);
+    return cache;
+}
+
+/**
+ * Description: Returns the size of the chunks in thread cache class c of allocator.
+ */
+static size_t tcache_class_size(struct Myalloc *allocator, int c) {
+    size_t step = allocator->min_alignment > TCACHE_CLASS_SIZE ? allocator->min_alignment : TCACHE_CLASS_SIZE;
+    return chunk_size(allocator, 0) + c * step;
+}
+
+/**
+ * Description: Returns the thread cache class of a chunk of _size bytes (a size chunk_size() returned): the smallest
+ *              class whose chunks hold it if _round_up, else the largest class it can serve. Returns -1 if that is
+ *              past the last class.
+ */
+static int tcache_class(struct Myalloc *allocator, size_t _size, bool _round_up) {
+    size_t step = allocator->min_alignment > TCACHE_CLASS_SIZE ? allocator->min_alignment : TCACHE_CLASS_SIZE;
+    size_t offset = _size - chunk_size(allocator, 0);
+    size_t c = (_round_up ? offset + step - 1 : offset) / step;
+    return c < TCACHE_NUM_CLASSES ? (int)c : -1;
+}
+
+/**
+ * Description: Returns a chunk of at least _size bytes (a size chunk_size() returned) from the calling thread's
+ *              cache, refilling the cache with a batch of chunks from the shared free lists when it is empty.
+ *              Returns NULL if _size is larger than the last class or the shared free lists can not refill the cache.
+ */
+static void* tcache_allocate(struct Myalloc *allocator, size_t _size) {
+    int c = tcache_class(allocator, _size, true);
+    if (c < 0) {
+        return NULL;
+    }
+    struct thread_cache *cache = tcache_acquire(allocator);
+    if (cache == NULL) {
+        return NULL;
+    }
+    if (cache->count[c] == 0) {
+        // take allocator->lock once for the whole batch
+        pthread_mutex_lock(&allocator->lock);
+        while (cache->count[c] < TCACHE_BATCH) {
+            void* chunk = allocate_chunk(allocator, tcache_class_size(allocator, c));
+            if (chunk == NULL) {
+                break;
+            }
+            // cached chunks are not allocated blocks until they are handed out
+            block_map_set(allocator, chunk, false);
+#ifdef MYALLOC_HARDENED
+            *(size_t*)chunk = FREED_POISON;
+#endif
+            cache->chunks[c][cache->count[c]++] = chunk;
+        }
+        pthread_mutex_unlock(&allocator->lock);
+    }
+    void* ptr = NULL;
+    if (cache->count[c] > 0) {
+#ifdef MYALLOC_HARDENED
+        // a random cached chunk, so the chunk freed last is not predictably the next one handed out
+        int i = random_next() % cache->count[c];
+        ptr = cache->chunks[c][i];
+        cache->chunks[c][i] = cache->chunks[c][--cache->count[c]];
+        if (*(size_t*)ptr != FREED_POISON) {
+            heap_corruption("write to a freed block", ptr);
+        }
+#else
+        ptr = cache->chunks[c][--cache->count[c]];
+#endif
+        block_map_set(allocator, ptr, true);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return ptr;
+}
+
+/**
+ * Description: Puts the chunk at _ptr into the calling thread's cache, flushing half of a full cache
+ *              class to the shared free lists first. Returns false if the chunk is not cacheable.
+ */
+static bool tcache_deallocate(struct Myalloc *allocator, void* _ptr) {
+    // a chunk may be larger than its class size when the leftover was too small to split off,
+    // so it goes to the largest class it can fully serve
+    int c = tcache_class(allocator, BLOCK_SIZE(_ptr), false);
+    // a fixed chunk is not cached: allocate() hands out cached chunks as movable ones, and clearing the flag
+    // here would write the tags without allocator->lock while a neighbour reads them to coalesce
+    if (c < 0 || (BLOCK_TAG(_ptr) & BLOCK_FIXED)) {
+        return false;
+    }
+    struct thread_cache *cache = tcache_acquire(allocator);
+    if (cache == NULL) {
+        return false;
+    }
+    if (cache->count[c] == TCACHE_CAPACITY) {
+        tcache_flush(cache, c, TCACHE_BATCH);
+    }
+#ifdef MYALLOC_HARDENED
+    *(size_t*)_ptr = FREED_POISON;
+#endif
+    cache->chunks[c][cache->count[c]++] = _ptr;
+    pthread_mutex_unlock(&cache->lock);
+    return true;
+}
+
+/**
+ * Description: Empties every thread's cache of allocator into its shared free lists and keeps those caches locked,
+ *              so no thread can take chunks out of the shared free lists until tcache_unlock_all() is called.
+ */
+static void tcache_lock_all(struct Myalloc *allocator) {
+    pthread_mutex_lock(&tcache_registry_lock);
+    for (struct thread_cache *cache = allocator->thread_caches; cache != NULL; cache = cache->next) {
+        pthread_mutex_lock(&cache->lock);
+        tcache_flush_all(cache);
+    }
+}
+
+static void tcache_unlock_all(struct Myalloc *allocator) {
+    for (struct thread_cache *cache = allocator->thread_caches; cache != NULL; cache = cache->next) {
+        pthread_mutex_unlock(&cache->lock);
+    }
+    pthread_mutex_unlock(&tcache_registry_lock);
+}
+
+/**
+ * Description: Returns the slab size class for a request of _size bytes, or -1 if it is not served from slabs.
+ *              Slots are aligned to their size, so classes below the minimum alignment are not used.
+ */
+static int slab_class(struct Myalloc *allocator, size_t _size) {
+    _size += CANARY_SIZE;
+    if (_size < (size_t)allocator->min_alignment) {
+        _size = allocator->min_alignment;
+    }
+    if (_size > SLAB_MAX_SIZE) {
+        return -1;
+    }
+    if (_size <= SLAB_MIN_SIZE) {
+        return 0;
+    }
+    return 64 - __builtin_clzll(_size - 1) - __builtin_ctz(SLAB_MIN_SIZE);
+}
+
+/**
+ * Description: Returns the slab holding _ptr, or NULL if _ptr is not in a slab of allocator.
+ */
+static struct slab* slab_of(struct Myalloc *allocator, void* _ptr) {
+    if ((uintptr_t)_ptr < allocator->slab_base) {
+        return NULL;
+    }
+    size_t page = ((uintptr_t)_ptr - allocator->slab_base) / SLAB_SIZE;
+    if (page >= allocator->slab_pages) {
+        return NULL;
+    }
+    unsigned long long word = atomic_load_explicit(&allocator->slab_pagemap[page / 64], memory_order_relaxed);
+    if (!(word & (1ull << (page % 64)))) {
+        return NULL;
+    }
+    return (struct slab*)((uintptr_t)_ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+static void slab_set_page(struct Myalloc *allocator, struct slab *slab, bool is_slab) {
+    size_t page = ((uintptr_t)slab - allocator->slab_base) / SLAB_SIZE;
+    if (is_slab) {
+        atomic_fetch_or_explicit(&allocator->slab_pagemap[page / 64], 1ull << (page % 64), memory_order_relaxed);
+    } else {
+        atomic_fetch_and_explicit(&allocator->slab_pagemap[page / 64], ~(1ull << (page % 64)), memory_order_relaxed);
+    }
+}
+
+static void slab_list_remove(struct Myalloc *allocator, int c, struct slab *slab) {
+    struct slab *prev = link_get(&slab->prev);
+    struct slab *next = link_get(&slab->next);
+    if (prev != NULL) {
+        link_set(&prev->next, next);
+    } else {
+        allocator->slabs[c] = next;
+    }
+    if (next != NULL) {
+        link_set(&next->prev, prev);
+    }
+}
+
+static void slab_list_insert(struct Myalloc *allocator, int c, struct slab *slab) {
+    link_set(&slab->prev, NULL);
+    link_set(&slab->next, allocator->slabs[c]);
+    if (allocator->slabs[c] != NULL) {
+        link_set(&allocator->slabs[c]->prev, slab);
+    }
+    allocator->slabs[c] = slab;
+}
+
+/**
+ * Description: Carves a new slab for size class c out of the memory chunk and makes it the first slab of its class.
+ *              The slab is one aligned chunk, so compaction never moves it.
+ *              Returns NULL if there is no free memory for a slab. allocator->lock must be held.
+ */
+static struct slab* slab_create(struct Myalloc *allocator, int c) {
+    size_t size = chunk_size(allocator, SLAB_SIZE);
+    struct slab *slab = allocate_aligned_chunk(allocator, size, SLAB_SIZE);
+    if (slab == NULL && grow_memory(allocator, size + SLAB_SIZE + HEADER_SIZE + FOOTER_SIZE + MIN_CHUNK_SIZE)) {
+        slab = allocate_aligned_chunk(allocator, size, SLAB_SIZE);
+    }
+    if (slab == NULL) {
+        return NULL;
+    }
+    slab->slot_size = SLAB_MIN_SIZE << c;
+    slab->slot_offset = (sizeof(struct slab) + slab->slot_size - 1) / slab->slot_size * slab->slot_size;
+    slab->slots = (SLAB_SIZE - slab->slot_offset) / slab->slot_size;
+    slab->free_slots = slab->slots;
+    for (unsigned i = 0; i < SLAB_BITMAP_WORDS; i++) {
+        unsigned first = i * 64;
+        if (first + 64 <= slab->slots) {
+            slab->free_bitmap[i] = ~0ull;
+        } else if (first < slab->slots) {
+            slab->free_bitmap[i] = (1ull << (slab->slots - first)) - 1;
+        } else {
+            slab->free_bitmap[i] = 0;
+        }
+    }
+#ifdef MYALLOC_HARDENED
+    for (unsigned i = 0; i < slab->slots; i++) {
+        *(size_t*)((char*)slab + slab->slot_offset + (size_t)i * slab->slot_size) = FREED_POISON;
+    }
+#endif
+    slab_list_insert(allocator, c, slab);
+    slab_set_page(allocator, slab, true);
+    return slab;
+}
+
+/**
+ * Description: Returns a free slot of size class c, creating a slab if no slab of the class has a free slot.
+ *              Returns NULL if no slab can be created. allocator->lock must be held.
+ */
+static void* slab_allocate(struct Myalloc *allocator, int c) {
+    struct slab *slab = allocator->slabs[c];
+    if (slab == NULL) {
+        slab = slab_create(allocator, c);
+        if (slab == NULL) {
+            return NULL;
+        }
+    }
+    unsigned i = 0;
+    while (slab->free_bitmap[i] == 0) {
+        i++;
+    }
+    unsigned slot = i * 64 + __builtin_ctzll(slab->free_bitmap[i]);
+    slab->free_bitmap[i] &= slab->free_bitmap[i] - 1;
+    // a full slab leaves the list until one of its slots is freed
+    if (--slab->free_slots == 0) {
+        slab_list_remove(allocator, c, slab);
+    }
+    char* ptr = (char*)slab + slab->slot_offset + (size_t)slot * slab->slot_size;
+    block_map_set(allocator, ptr, true);
+#ifdef MYALLOC_HARDENED
+    if (*(size_t*)ptr != FREED_POISON) {
+        heap_corruption("write to a freed block", ptr);
+    }
+    *(size_t*)(ptr + slab->slot_size - CANARY_SIZE) = CANARY_VALUE(slab->slot_size);
+#endif
+    return ptr;
+}
+
+/**
+ * Description: Takes the slot at _ptr of slab out of the block map before it is returned to the slab, so of two
+ *              racing deallocations of the slot only one goes ahead, also when one of them is deferred.
+ *              Returns false and reports the pointer if it is not an allocated slot. Needs no lock: the layout of a
+ *              slab does not change while one of its slots is allocated.
+ */
+static bool slot_claim(struct Myalloc *allocator, struct slab *slab, void* _ptr) {
+    // a pointer into a slot would corrupt the bitmap and a free slot would be counted free twice, both are found
+    // in O(1)
+    size_t offset = (char*)_ptr - (char*)slab;
+    if (offset < slab->slot_offset || (offset - slab->slot_offset) % slab->slot_size != 0 ||
+        !block_map_claim(allocator, _ptr)) {
+        invalid_pointer("deallocate", _ptr);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Description: Returns the slot at _ptr, which slot_claim() has taken out of the block map, to its slab. An empty
+ *              slab is given back to the memory chunk unless it is the only slab of its class with free slots.
+ *              allocator->lock must be held.
+ */
+static void slab_deallocate(struct Myalloc *allocator, struct slab *slab, void* _ptr) {
+    int c = __builtin_ctz(slab->slot_size / SLAB_MIN_SIZE);
+    unsigned slot = ((char*)_ptr - (char*)slab - slab->slot_offset) / slab->slot_size;
+#ifdef MYALLOC_HARDENED
+    if (*(size_t*)((char*)_ptr + slab->slot_size - CANARY_SIZE) != CANARY_VALUE(slab->slot_size)) {
+        heap_corruption("write past the end of the block", _ptr);
+    }
+    *(size_t*)_ptr = FREED_POISON;
+#endif
+    assert(!(slab->free_bitmap[slot / 64] & (1ull << (slot % 64))));
+    slab->free_bitmap[slot / 64] |= 1ull << (slot % 64);
+    if (slab->free_slots++ == 0) {
+        slab_list_insert(allocator, c, slab);
+    }
+    if (slab->free_slots == slab->slots && (allocator->slabs[c] != slab || slab->next != 0)) {
+        slab_list_remove(allocator, c, slab);
+        slab_set_page(allocator, slab, false);
+        deallocate_chunk(allocator, slab);
+    }
+}
+
+/**
+ * Description: Pushes the block or slot at _ptr on the deferred free stack of allocator without taking the lock.
+ */
+static void defer_free(struct Myalloc *allocator, void* _ptr) {
+    void* head = atomic_load_explicit(&allocator->deferred_frees, memory_order_relaxed);
+    do {
+        *(void**)_ptr = head;
+    } while (!atomic_compare_exchange_weak_explicit(&allocator->deferred_frees, &head, _ptr, memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+/**
+ * Description: Returns every block of the deferred free stack to the free lists and slabs, coalescing the blocks
+ *              with their free neighbours. A single load when the stack is empty. allocator->lock must be held.
+ */
+static void drain_deferred_frees(struct Myalloc *allocator) {
+    if (atomic_load_explicit(&allocator->deferred_frees, memory_order_relaxed) == NULL) {
+        return;
+    }
+    void* ptr = atomic_exchange_explicit(&allocator->deferred_frees, NULL, memory_order_acquire);
+    while (ptr != NULL) {
+        void* next = *(void**)ptr;
+        struct slab *slab = (allocator->flags & MYALLOC_SLABS) ? slab_of(allocator, ptr) : NULL;
+        if (slab != NULL) {
+            slab_deallocate(allocator, slab, ptr);
+        } else {
+            deallocate_chunk(allocator, ptr);
+        }
+        ptr = next;
+    }
+    trim_memory(allocator);
+}
+
+/**
+ * Description: Allocates a block of _size bytes from allocator, see allocate().
+ */
+static void* allocate_block(struct Myalloc *allocator, size_t _size) {
+    assert(_size > 0);
+    void* ptr = NULL;
+
+    // Inside a region the block is the next _size bytes of the region, without tags
+    if (region.allocator == allocator) {
+        size_t size = (_size + allocator->min_alignment - 1) & ~(size_t)(allocator->min_alignment - 1);
+        if (size > (size_t)(region.end - region.top)) {
+            return NULL;
+        }
+        ptr = region.top;
+        region.top += size;
+        region.last = ptr;
+        return ptr;
+    }
+
+    // Small requests are served from a slab, the general chunks are used when no slab can be created
+    if (allocator->flags & MYALLOC_SLABS) {
+        int c = slab_class(allocator, _size);
+        if (c >= 0) {
+            pthread_mutex_lock(&allocator->lock);
+            drain_deferred_frees(allocator);
+            ptr = slab_allocate(allocator, c);
+            pthread_mutex_unlock(&allocator->lock);
+            if (ptr != NULL) {
+                return ptr;
+            }
+        }
+    }
+    _size = chunk_size(allocator, _size);
+
+    // Small requests are served from the calling thread's cache without taking allocator->lock
+    if (allocator->flags & MYALLOC_THREAD_CACHE) {
+        ptr = tcache_allocate(allocator, _size);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+
+    // Allocate memory from allocator->memory 
+    // ptr = address of allocated memory
+
+    // Lock the mutex before accesing shared data structures
+    pthread_mutex_lock(&allocator->lock);
+    drain_deferred_frees(allocator);
+
+    if (allocator->address_tree == NULL && !grow_memory(allocator, _size)) {
+        // Lock the mutex before returning
+        pthread_mutex_unlock(&allocator->lock);    
+        return NULL;
+    }
+    ptr = allocate_chunk(allocator, _size);
+    // A growable allocator maps more memory when no free chunk is large enough
+    if (ptr == NULL && grow_memory(allocator, _size)) {
+        ptr = allocate_chunk(allocator, _size);
+    }
+
+    // If we can not find sufficient space, return NULL
+    if (ptr == NULL) {
+        pthread_mutex_unlock(&allocator->lock);
+        return NULL;
+    }
+
+    pthread_mutex_unlock(&allocator->lock);
+    return ptr;
+}
+
+/**
+ * Description: Allocates a block of _size bytes aligned to _alignment from allocator, see allocate_aligned().
+ */
+static void* allocate_aligned_block(struct Myalloc *allocator, size_t _size, size_t _alignment) {
+    assert(_size > 0);
+    assert(_alignment > 0 && (_alignment & (_alignment - 1)) == 0);
+    // every chunk is aligned to the minimum alignment already
+    if (_alignment <= (size_t)allocator->min_alignment) {
+        return allocate_block(allocator, _size);
+    }
+    _size = chunk_size(allocator, _size);
+
+    pthread_mutex_lock(&allocator->lock);
+    drain_deferred_frees(allocator);
+    void* ptr = allocate_aligned_chunk(allocator, _size, _alignment);
+    // A growable allocator maps more memory when no free chunk is large enough, with room for the padding
+    if (ptr == NULL && grow_memory(allocator, _size + _alignment + HEADER_SIZE + FOOTER_SIZE + MIN_CHUNK_SIZE)) {
+        ptr = allocate_aligned_chunk(allocator, _size, _alignment);
+    }
+    pthread_mutex_unlock(&allocator->lock);
+    return ptr;
+}
+
+/**
+ * Description: Returns the block at _ptr back to allocator, see deallocate().
+ */
+static void deallocate_block(struct Myalloc *allocator, void* _ptr) {
+    assert(_ptr != NULL);
+
+    // Blocks of the region are released all at once by region_reset() and region_end()
+    if (region.allocator == allocator && (char*)_ptr >= region.start && (char*)_ptr < region.end) {
+        return;
+    }
+
+    // Free allocated memory
+    // Note: _ptr points to the user-visible memory. The size information is
+    // stored in the header at (char*)_ptr - 8 and in the footer at (char*)_ptr + size.
+
+    // Threads that do not own a MYALLOC_DEFERRED_FREE allocator never wait for its lock, the block is pushed on the
+    // deferred free stack and returned by the next allocation
+    //      - the block map bit of the block or slot is cleared right away, so a second deallocation is caught here
+    //        and the block is pushed at most once
+    if ((allocator->flags & MYALLOC_DEFERRED_FREE) &&
+        atomic_load_explicit(&allocator->owner, memory_order_relaxed) != &thread_marker) {
+        struct slab *slab = (allocator->flags & MYALLOC_SLABS) ? slab_of(allocator, _ptr) : NULL;
+        if (slab != NULL) {
+            if (!slot_claim(allocator, slab, _ptr)) {
+                return;
+            }
+        } else if (!is_block(allocator, _ptr) || (BLOCK_TAG(_ptr) & BLOCK_HANDLE) ||
+                   !block_map_claim(allocator, _ptr)) {
+            invalid_pointer("deallocate", _ptr);
+            return;
+        } else {
+            check_chunk(_ptr);
+        }
+        defer_free(allocator, _ptr);
+        return;
+    }
+
+    // Slots have no tags, the pagemap tells whether _ptr is in a slab
+    if (allocator->flags & MYALLOC_SLABS) {
+        struct slab *slab = slab_of(allocator, _ptr);
+        if (slab != NULL) {
+            if (!slot_claim(allocator, slab, _ptr)) {
+                return;
+            }
+            pthread_mutex_lock(&allocator->lock);
+            drain_deferred_frees(allocator);
+            slab_deallocate(allocator, slab, _ptr);
+            trim_memory(allocator);
+            pthread_mutex_unlock(&allocator->lock);
+            return;
+        }
+    }
+
+    // Freeing anything but an allocated block would corrupt the free lists, the block map checks it in O(1)
+    if (!is_block(allocator, _ptr) || (BLOCK_TAG(_ptr) & BLOCK_HANDLE)) {
+        invalid_pointer("deallocate", _ptr);
+        return;
+    }
+    check_chunk(_ptr);
+    // the chunk leaves the block map before it is cached or quarantined, so freeing it again is caught above and
+    // compact_step() can tell cached chunks from allocated ones
+    if (!block_map_claim(allocator, _ptr)) {
+        invalid_pointer("deallocate", _ptr);
+        return;
+    }
+
+    // Small chunks go back to the calling thread's cache while it has room
+    if (allocator->flags & MYALLOC_THREAD_CACHE) {
+        if (tcache_deallocate(allocator, _ptr)) {
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&allocator->lock);
+
+    drain_deferred_frees(allocator);
+    if (!quarantine_chunk(allocator, _ptr)) {
+        deallocate_chunk(allocator, _ptr);
+    }
+    trim_memory(allocator);
+
+    pthread_mutex_unlock(&allocator->lock);
+}
+
+/**
+ * Description: Shrinks the allocated chunk at ptr to _size bytes (already rounded by chunk_size()) and returns the
+ *              tail to the free lists, merged with the right neighbour if that one is free. The tail stays part of
+ *              the chunk when it is too small to be a free chunk. allocator->lock must be held.
+ */
+static void shrink_chunk(struct Myalloc *allocator, void* ptr, size_t _size) {
+    size_t leftover = BLOCK_SIZE(ptr) - _size;
+    if (leftover < HEADER_SIZE + FOOTER_SIZE + MIN_CHUNK_SIZE) {
+        return;
+    }
+    void* right = next_block(ptr);
+    set_tags(ptr, _size, BLOCK_TAG(ptr) & BLOCK_FLAGS);
+    atomic_fetch_sub_explicit(&allocator->used_memory, leftover, memory_order_relaxed);
+    void* tail = next_block(ptr);
+    size_t tail_size = leftover - FOOTER_SIZE - HEADER_SIZE;
+    if (!is_allocated(right)) {
+        free_list_remove(allocator, right);
+        if (allocator->compact_cursor == right) {
+            allocator->compact_cursor = tail;
+        }
+        tail_size += FOOTER_SIZE + HEADER_SIZE + BLOCK_SIZE(right);
+    }
+    set_tags(tail, tail_size, 0);
+    free_list_insert(allocator, tail);
+}
+
+/**
+ * Description: Resizes the allocated chunk at ptr to _size bytes (already rounded by chunk_size()) without moving
+ *              it, taking the room from its free right neighbour when it grows. A growable allocator maps more memory
+ *              when ptr is the last chunk. Returns false if ptr cannot grow in place. allocator->lock must be held.
+ */
+static bool resize_chunk(struct Myalloc *allocator, void* ptr, size_t _size) {
+    size_t size = BLOCK_SIZE(ptr);
+    if (_size > size) {
+        // the right neighbour has to be free and large enough to cover the difference together with its tags
+        void* right = next_block(ptr);
+        if (is_epilogue(right) || (!is_allocated(right) && is_epilogue(next_block(right)))) {
+            size_t available = is_epilogue(right) ? 0 : BLOCK_SIZE(right) + FOOTER_SIZE + HEADER_SIZE;
+            if (size + available < _size && grow_memory(allocator, _size - size)) {
+                right = next_block(ptr);
+            }
+        }
+        if (is_allocated(right) || size + FOOTER_SIZE + HEADER_SIZE + BLOCK_SIZE(right) < _size) {
+            return false;
+        }
+        free_list_remove(allocator, right);
+        if (allocator->compact_cursor == right) {
+            allocator->compact_cursor = ptr;
+        }
+        size_t grown = size + FOOTER_SIZE + HEADER_SIZE + BLOCK_SIZE(right);
+        set_tags(ptr, grown, BLOCK_TAG(ptr) & BLOCK_FLAGS);
+        atomic_fetch_add_explicit(&allocator->used_memory, grown - size, memory_order_relaxed);
+    }
+    shrink_chunk(allocator, ptr, _size);
+    return true;
+}
+
+/**
+ * Description: Resizes the block at _ptr of allocator to _size bytes, see reallocate().
+ */
+static void* reallocate_block(struct Myalloc *allocator, void* _ptr, size_t _size) {
+    assert(_size > 0);
+    if (_ptr == NULL) {
+        return allocate_block(allocator, _size);
+    }
+    size_t old_size = 0;
+
+    // The latest block of a region grows and shrinks by moving the top, other region blocks are copied to the top
+    //      - region blocks have no tags, so at most the bytes up to the top are copied
+    if (region.allocator == allocator && (char*)_ptr >= region.start && (char*)_ptr < region.end) {
+        if (_ptr == region.last) {
+            size_t size = (_size + allocator->min_alignment - 1) & ~(size_t)(allocator->min_alignment - 1);
+            if (size > (size_t)(region.end - (char*)_ptr)) {
+                return NULL;
+            }
+            region.top = (char*)_ptr + size;
+            return _ptr;
+        }
+        old_size = region.top - (char*)_ptr;
+    } else if ((allocator->flags & MYALLOC_SLABS) && slab_of(allocator, _ptr) != NULL) {
+        // a slot keeps serving every size up to its slot size
+        old_size = slab_of(allocator, _ptr)->slot_size - CANARY_SIZE;
+        if (_size <= old_size) {
+            return _ptr;
+        }
+    } else {
+        if (!is_block(allocator, _ptr) || (BLOCK_TAG(_ptr) & BLOCK_HANDLE)) {
+            invalid_pointer("reallocate", _ptr);
+            return NULL;
+        }
+        check_chunk(_ptr);
+        pthread_mutex_lock(&allocator->lock);
+        drain_deferred_frees(allocator);
+        bool resized = resize_chunk(allocator, _ptr, chunk_size(allocator, _size));
+        if (resized) {
+            trim_memory(allocator);
+        }
+        old_size = BLOCK_SIZE(_ptr) - CANARY_SIZE;
+        pthread_mutex_unlock(&allocator->lock);
+        if (resized) {
+            return _ptr;
+        }
+    }
+
+    // Move the block as a last resort, the old block stays allocated if there is no room for the new one
+    void* ptr = allocate_block(allocator, _size);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    memcpy(ptr, _ptr, old_size < _size ? old_size : _size);
+    deallocate_block(allocator, _ptr);
+    return ptr;
+}
+
+// Return address of a public entry point, reported as the caller of a traced call
+#ifdef MYALLOC_TRACE
+#define TRACE_CALLER __builtin_return_address(0)
+#else
+#define TRACE_CALLER NULL
+#endif
+
+#ifdef MYALLOC_TRACE
+/**
+ * Description: Returns the monotonic clock in nanoseconds.
+ */
+static uint64_t trace_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Description: Returns true if the calling thread's current call on allocator is sampled. Only a relaxed load
+ *              and a thread-local countdown when tracing is on, a single load when it is off.
+ */
+static bool trace_sampled(struct Myalloc *allocator) {
+    unsigned period = atomic_load_explicit(&allocator->trace_period, memory_order_acquire);
+    if (period == 0) {
+        return false;
+    }
+    if (trace_countdown == 0 || trace_countdown > period) {
+        trace_countdown = period;
+    }
+    return --trace_countdown == 0;
+}
+
+/**
+ * Description: Returns the size of the block at _ptr, the slot size of a slot and 0 for region blocks and pointers
+ *              that are not blocks.
+ */
+static size_t trace_block_size(struct Myalloc *allocator, void* _ptr) {
+    if (region.allocator == allocator && (char*)_ptr >= region.start && (char*)_ptr < region.end) {
+        return 0;
+    }
+    if (allocator->flags & MYALLOC_SLABS) {
+        struct slab *slab = slab_of(allocator, _ptr);
+        if (slab != NULL) {
+            return slab->slot_size;
+        }
+    }
+    return is_block(allocator, _ptr) ? BLOCK_SIZE(_ptr) : 0;
+}
+
+/**
+ * Description: Appends _event to ring, or counts it as dropped if the ring is full.
+ */
+static void trace_push(struct trace_ring* _ring, const struct myalloc_trace_event* _event) {
+    size_t pos = atomic_load_explicit(&_ring->head, memory_order_relaxed);
+    for (;;) {
+        struct trace_slot *slot = &_ring->slots[pos % TRACE_RING_SIZE];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)(sequence - pos);
+        if (diff == 0) {
+            // the entry is empty, claim its position
+            if (atomic_compare_exchange_weak_explicit(&_ring->head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                slot->event = *_event;
+                atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+                return;
+            }
+        } else if (diff < 0) {
+            // the entry still holds the event from one lap ago, the ring is full
+            atomic_fetch_add_explicit(&_ring->dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            // another thread claimed pos first
+            pos = atomic_load_explicit(&_ring->head, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Description: Records a sampled call that started at _start in the trace ring and passes it to the callback.
+ */
+static void trace_record(struct Myalloc *allocator, enum myalloc_trace_op _op, void* _ptr, void* _old_ptr,
+                         size_t _size, void* _caller, uint64_t _start) {
+    uint64_t end = trace_clock();
+    struct myalloc_trace_event event = {
+        .op = _op, .ptr = _ptr, .old_ptr = _old_ptr, .size = _size, .caller = _caller,
+        .time_ns = end, .latency_ns = end - _start,
+    };
+    trace_push(allocator->trace_ring, &event);
+    myalloc_trace_fn fn = atomic_load_explicit(&allocator->trace_fn, memory_order_relaxed);
+    if (fn != NULL) {
+        fn(&event, atomic_load_explicit(&allocator->trace_arg, memory_order_relaxed));
+    }
+}
+#endif
+
+/**
+ * Description: Allocates a block for a public entry point called from _caller, aligned to _alignment if it is not 0.
+ *              The call is recorded when it is sampled.
+ */
+static inline void* traced_allocate(struct Myalloc *allocator, size_t _size, size_t _alignment, void* _caller) {
+#ifdef MYALLOC_TRACE
+    if (trace_sampled(allocator)) {
+        uint64_t start = trace_clock();
+        void* ptr = _alignment ? allocate_aligned_block(allocator, _size, _alignment) : allocate_block(allocator, _size);
+        trace_record(allocator, MYALLOC_TRACE_ALLOCATE, ptr, NULL, _size, _caller, start);
+        return ptr;
+    }
+#endif
+    (void)_caller;
+    return _alignment ? allocate_aligned_block(allocator, _size, _alignment) : allocate_block(allocator, _size);
+}
+
+/**
+ * Description: Deallocates a block for a public entry point called from _caller. The call is recorded when it is
+ *              sampled, with the size of the block.
+ */
+static inline void traced_deallocate(struct Myalloc *allocator, void* _ptr, void* _caller) {
+#ifdef MYALLOC_TRACE
+    if (trace_sampled(allocator)) {
+        size_t size = trace_block_size(allocator, _ptr);
+        uint64_t start = trace_clock();
+        deallocate_block(allocator, _ptr);
+        trace_record(allocator, MYALLOC_TRACE_DEALLOCATE, _ptr, NULL, size, _caller, start);
+        return;
+    }
+#endif
+    (void)_caller;
+    deallocate_block(allocator, _ptr);
+}
+
+/**
+ * Description: Reallocates a block for a public entry point called from _caller. The call is recorded when it is
+ *              sampled, with the old address of the block.
+ */
+static inline void* traced_reallocate(struct Myalloc *allocator, void* _ptr, size_t _size, void* _caller) {
+#ifdef MYALLOC_TRACE
+    if (trace_sampled(allocator)) {
+        uint64_t start = trace_clock();
+        void* ptr = reallocate_block(allocator, _ptr, _size);
+        trace_record(allocator, MYALLOC_TRACE_REALLOCATE, ptr, _ptr, _size, _caller, start);
+        return ptr;
+    }
+#endif
+    (void)_caller;
+    return reallocate_block(allocator, _ptr, _size);
+}
+
+/**
+ * Description: Same as allocate(), served from _allocator.
+ */
+void* myalloc_alloc(struct Myalloc* _allocator, size_t _size) {
+    return traced_allocate(_allocator, _size, 0, TRACE_CALLER);
+}
+
+/**
+ * Description: Same as allocate_aligned(), served from _allocator.
+ */
+void* myalloc_alloc_aligned(struct Myalloc* _allocator, size_t _size, size_t _alignment) {
+    return traced_allocate(_allocator, _size, _alignment, TRACE_CALLER);
+}
+
+/**
+ * Description: Same as deallocate(), returns the chunk back to _allocator.
+ * Precondition: The pointer was returned by myalloc_alloc() on _allocator and is still allocated
+ */
+void myalloc_free(struct Myalloc* _allocator, void* _ptr) {
+    traced_deallocate(_allocator, _ptr, TRACE_CALLER);
+}
+
+/**
+ * Description: Same as reallocate(), for a block of _allocator.
+ * Precondition: The pointer is NULL or was returned by myalloc_alloc() on _allocator and is still allocated
+ */
+void* myalloc_realloc(struct Myalloc* _allocator, void* _ptr, size_t _size) {
+    return traced_reallocate(_allocator, _ptr, _size, TRACE_CALLER);
+}
+
+/**
+ * Description: Same as contains(), for the memory chunk of _allocator.
+ */
+bool myalloc_contains(struct Myalloc* _allocator, void* _ptr) {
+    // a growable memory chunk can grow up to the end of its reservation, size only changes under the lock
+    //      - not the end of the block map, which is rounded up to pages and may cover memory of other allocators
+    uintptr_t end = (_allocator->flags & MYALLOC_GROWABLE) ? (uintptr_t)_allocator + _allocator->reserved_size
+                                                           : (uintptr_t)_allocator->memory + _allocator->size;
+    return (uintptr_t)_ptr >= (uintptr_t)_allocator->memory && (uintptr_t)_ptr < end;
+}
+
+/**
+ * Description: Same as usable_size(), for a block of _allocator.
+ */
+size_t myalloc_usable_size(struct Myalloc* _allocator, void* _ptr) {
+    struct slab *slab = slab_of(_allocator, _ptr);
+    if (slab != NULL) {
+        return slab->slot_size - CANARY_SIZE;
+    }
+    if (!is_block(_allocator, _ptr)) {
+        return 0;
+    }
+    // the tags of an allocated block only change when its owner frees or resizes it
+    return BLOCK_SIZE(_ptr) - CANARY_SIZE - ((BLOCK_TAG(_ptr) & BLOCK_HANDLE) ? HANDLE_INDEX_SIZE : 0);
+}
+
+/**
+ * Description: Carves the blocks of the batch that are still NULL in _out out of the free chunk at ptr, one right
+ *              after the other. ptr must have left the free lists and hold all of them with their tags, the rest of
+ *              it is split off after the last block. allocator->lock must be held.
+ */
+static void carve_chunks(struct Myalloc *allocator, void* ptr, const size_t* _sizes, int _n, void** _out) {
+    char* block = ptr;
+    size_t remaining = BLOCK_SIZE(ptr);
+    int last = _n - 1;
+    while (_out[last] != NULL) {
+        last--;
+    }
+    size_t carved_size = 0;
+    int carved_chunks = 0;
+    for (int i = 0; i < last; i++) {
+        if (_out[i] != NULL) {
+            continue;
+        }
+        size_t size = chunk_size(allocator, _sizes[i]);
+        set_tags(block, size, BLOCK_ALLOCATED);
+        block_map_set(allocator, block, true);
+        _out[i] = block;
+        carved_size += size;
+        carved_chunks++;
+        remaining -= size + FOOTER_SIZE + HEADER_SIZE;
+        block += size + FOOTER_SIZE + HEADER_SIZE;
+    }
+    atomic_fetch_add_explicit(&allocator->used_memory, carved_size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocator->allocated_chunks, carved_chunks, memory_order_relaxed);
+    // the last block takes what is left, split_chunk() returns the rest to the free lists
+    set_tags(block, remaining, 0);
+    split_chunk(allocator, block, chunk_size(allocator, _sizes[last]), BLOCK_ALLOCATED);
+    _out[last] = block;
+}
+
+/**
+ * Description: Same as allocate_batch(), served from _allocator.
+ */
+int myalloc_alloc_batch(struct Myalloc* _allocator, const size_t* _sizes, int _n, void** _out) {
+    int allocated = 0;
+    pthread_mutex_lock(&_allocator->lock);
+    drain_deferred_frees(_allocator);
+
+    // Small requests are served from slabs first, the rest is carved from one free chunk if one holds all of them
+    //      - total_size is the payload of a chunk holding the remaining blocks with their tags
+    size_t total_size = 0;
+    int remaining = 0;
+    for (int i = 0; i < _n; i++) {
+        assert(_sizes[i] > 0);
+        _out[i] = NULL;
+        int c = (_allocator->flags & MYALLOC_SLABS) ? slab_class(_allocator, _sizes[i]) : -1;
+        if (c >= 0) {
+            _out[i] = slab_allocate(_allocator, c);
+        }
+        if (_out[i] != NULL) {
+            allocated++;
+        } else {
+            total_size += (remaining > 0 ? FOOTER_SIZE + HEADER_SIZE : 0) + chunk_size(_allocator, _sizes[i]);
+            remaining++;
+        }
+    }
+    if (remaining > 0) {
+        void* ptr = find_free_chunk(_allocator, total_size);
+        if (ptr == NULL && grow_memory(_allocator, total_size)) {
+            ptr = find_free_chunk(_allocator, total_size);
+        }
+        if (ptr != NULL) {
+            free_list_remove(_allocator, ptr);
+            carve_chunks(_allocator, ptr, _sizes, _n, _out);
+            allocated += remaining;
+        } else {
+            // one chunk at a time, still under a single lock
+            for (int i = 0; i < _n; i++) {
+                if (_out[i] != NULL) {
+                    continue;
+                }
+                size_t size = chunk_size(_allocator, _sizes[i]);
+                _out[i] = allocate_chunk(_allocator, size);
+                if (_out[i] == NULL && grow_memory(_allocator, size)) {
+                    _out[i] = allocate_chunk(_allocator, size);
+                }
+                if (_out[i] != NULL) {
+                    allocated++;
+                }
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&_allocator->lock);
+    return allocated;
+}
+
+static int compare_addresses(const void* _a, const void* _b) {
+    uintptr_t a = (uintptr_t)*(void* const*)_a;
+    uintptr_t b = (uintptr_t)*(void* const*)_b;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Description: Returns the allocated chunks in _sorted, which are sorted by address and have already been cleared
+ *              from the block map and passed over by the quarantine, to the free lists in one pass.
+ *              A run of chunks that are physically next to each other, with or without free chunks between them,
+ *              becomes a single free chunk, so it enters the free lists once. allocator->lock must be held.
+ */
+static void deallocate_sorted_chunks(struct Myalloc *allocator, void** _sorted, int _n) {
+    int i = 0;
+    while (i < _n) {
+        size_t freed_size = 0;
+        int freed_chunks = 0;
+        // the run starts at its first chunk, or at the free chunk to the left of it
+        void* start = _sorted[i];
+        void* left = prev_free_block(start);
+        if (left != NULL) {
+            free_list_remove(allocator, left);
+            start = left;
+        }
+        void* end = _sorted[i];
+        freed_size += BLOCK_SIZE(end);
+        freed_chunks++;
+        i++;
+        while (true) {
+            void* next = next_block(end);
+            if (!is_allocated(next)) {
+                free_list_remove(allocator, next);
+            } else if (i < _n && next == _sorted[i]) {
+                freed_size += BLOCK_SIZE(next);
+                freed_chunks++;
+                i++;
+            } else {
+                break;
+            }
+            end = next;
+        }
+        atomic_fetch_sub_explicit(&allocator->used_memory, freed_size, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&allocator->allocated_chunks, freed_chunks, memory_order_relaxed);
+        // a compaction cursor on a chunk inside the run moves to its start
+        if ((char*)allocator->compact_cursor > (char*)start && (char*)allocator->compact_cursor <= (char*)end) {
+            allocator->compact_cursor = start;
+        }
+        set_tags(start, (char*)end + BLOCK_SIZE(end) - (char*)start, 0);
+        free_list_insert(allocator, start);
+    }
+}
+
+/**
+ * Description: Same as deallocate_batch(), returns the chunks back to _allocator.
+ */
+void myalloc_free_batch(struct Myalloc* _allocator, void* const* _ptrs, int _n) {
+    // the chunks are sorted by address in a copy, a small batch is sorted on the stack
+    void* local[64];
+    void** sorted = _n <= 64 ? local : malloc(_n * sizeof(void*));
+
+    pthread_mutex_lock(&_allocator->lock);
+    drain_deferred_frees(_allocator);
+
+    int chunks = 0;
+    for (int i = 0; i < _n; i++) {
+        assert(_ptrs[i] != NULL);
+        struct slab *slab = (_allocator->flags & MYALLOC_SLABS) ? slab_of(_allocator, _ptrs[i]) : NULL;
+        if (region.allocator == _allocator && (char*)_ptrs[i] >= region.start && (char*)_ptrs[i] < region.end) {
+            // released with the region
+        } else if (slab != NULL) {
+            if (slot_claim(_allocator, slab, _ptrs[i])) {
+                slab_deallocate(_allocator, slab, _ptrs[i]);
+            }
+        } else if (!is_block(_allocator, _ptrs[i]) || (BLOCK_TAG(_ptrs[i]) & BLOCK_HANDLE)) {
+            invalid_pointer("deallocate", _ptrs[i]);
+        } else {
+            check_chunk(_ptrs[i]);
+            // leaving the block map right away also catches a pointer that appears twice in the batch, and of a
+            // batch racing with a deallocate() of the same block on another thread only one goes ahead
+            if (!block_map_claim(_allocator, _ptrs[i])) {
+                invalid_pointer("deallocate", _ptrs[i]);
+            } else if (quarantine_chunk(_allocator, _ptrs[i])) {
+                // poisoned, the chunk it evicted was checked and returned to the free lists
+            } else if (sorted != NULL) {
+                sorted[chunks++] = _ptrs[i];
+            } else {
+                deallocate_chunk(_allocator, _ptrs[i]);
+            }
+        }
+    }
+    if (chunks > 0) {
+        qsort(sorted, chunks, sizeof(void*), compare_addresses);
+        deallocate_sorted_chunks(_allocator, sorted, chunks);
+    }
+    trim_memory(_allocator);
+
+    pthread_mutex_unlock(&_allocator->lock);
+    if (sorted != local) {
+        free(sorted);
+    }
+}
+
+/**
+ * Description: Returns the arena of the default allocator the calling thread allocates from: the arena of its
+ *              NUMA node, or the arena of its region while it has one.
+ */
+static inline struct Myalloc* local_arena() {
+    if (arena_count <= 1) {
+        return myalloc;
+    }
+    // a region stays on the arena it was carved from when the thread moves to another node
+    if (region.allocator != NULL) {
+        for (int i = 0; i < arena_count; i++) {
+            if (arenas[i] == region.allocator) {
+                return region.allocator;
+            }
+        }
+    }
+    int node = myalloc_numa_node();
+    return node < arena_count ? arenas[node] : myalloc;
+}
+
+/**
+ * Description: Returns the arena of the default allocator whose memory chunk holds _ptr, myalloc if none does so
+ *              the pointer is reported like any other foreign pointer.
+ */
+static inline struct Myalloc* arena_of(void* _ptr) {
+    if (arena_count <= 1) {
+        return myalloc;
+    }
+    for (int i = 0; i < arena_count; i++) {
+        if (myalloc_contains(arenas[i], _ptr)) {
+            return arenas[i];
+        }
+    }
+    return myalloc;
+}
+
+/**
+ * Description: Similar to malloc call in C.
+ *              Returns a pointer to the allocated block of size _size.
+ *              If allocation cannot be satisfied, returns NULL
+ *              Every block takes at least 56 bytes of the memory chunk with its boundary tags, whatever _size is,
+ *              unless it is a slot (MYALLOC_SLABS) or a region block.
+ */
+void* allocate(size_t _size) {
+    return traced_allocate(local_arena(), _size, 0, TRACE_CALLER);
+}
+
+/**
+ * Description: Similar to aligned_alloc call in C.
+ *              Returns a pointer to an allocated block of size _size whose address is a multiple of _alignment,
+ *              which must be a power of two. If allocation cannot be satisfied, returns NULL
+ *              Blocks aligned beyond the minimum alignment of the allocator are not moved by compaction.
+ */
+void* allocate_aligned(size_t _size, size_t _alignment) {
+    return traced_allocate(local_arena(), _size, _alignment, TRACE_CALLER);
+}
+
+/**
+ * Description: Similar to free call in C.
+ *              Takes a pointer to a chunk of memory as the sole parameter and returns it back to the allocator.
+ *              A pointer that is not an allocated block (a double free, a pointer into a block or outside the
+ *              memory chunk) is found in constant time with the block map and ignored with an error message.
+ *              Built with -DMYALLOC_HARDENED it aborts instead, and so does a block whose tags or canary were
+ *              overwritten.
+ * Precondition: The pointer is a valid entry in memory and is an allocated chunk
+ */
+void deallocate(void* _ptr) {
+    traced_deallocate(arena_of(_ptr), _ptr, TRACE_CALLER);
+}
+
+/**
+ * Description: Similar to realloc call in C.
+ *              Resizes the block at _ptr to _size bytes and returns its address. A block grows in place by taking
+ *              the room of the free chunk right after it and shrinks in place by returning its tail to the free lists,
+ *              it is only moved (copied to a new block and freed) when the chunk after it is allocated or too small.
+ *              A moved block has the minimum alignment of the allocator. If the block cannot be resized,
+ *              returns NULL and the block is left as it was. A NULL _ptr allocates a new block.
+ * Precondition: The pointer is NULL or an allocated block
+ */
+void* reallocate(void* _ptr, size_t _size) {
+    return traced_reallocate(_ptr != NULL ? arena_of(_ptr) : local_arena(), _ptr, _size, TRACE_CALLER);
+}
+
+/**
+ * Description: Returns true if _ptr points into the memory chunk of the allocator, so a program that mixes this
+ *              allocator with another one can tell whose block it has. Takes constant time and no lock.
+ */
+bool contains(void* _ptr) {
+    for (int i = 0; i < arena_count; i++) {
+        if (myalloc_contains(arenas[i], _ptr)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Description: Similar to malloc_usable_size call in C.
+ *              Returns the number of bytes of the block at _ptr that can be used, at least the requested size.
+ *              Returns 0 for pointers that are not allocated blocks and for blocks of a region.
+ */
+size_t usable_size(void* _ptr) {
+    return myalloc_usable_size(arena_of(_ptr), _ptr);
+}
+
+/**
+ * Description: Allocates _n blocks, block i of size _sizes[i], and stores them in _out with a single lock
+ *              acquisition. The blocks are carved one after the other from one free chunk when a free chunk can hold
+ *              all of them. Returns the number of blocks allocated, _out[i] is NULL for every block that could not be.
+ */
+int allocate_batch(const size_t* _sizes, int _n, void** _out) {
+    return myalloc_alloc_batch(local_arena(), _sizes, _n, _out);
+}
+
+/**
+ * Description: Returns the _n blocks in _ptrs back to the allocator with a single lock acquisition. The blocks are
+ *              coalesced in one pass in address order, so blocks that are next to each other are merged before they
+ *              enter the free lists.
+ *              Pointers that are not allocated blocks are reported and skipped like in deallocate().
+ */
+void deallocate_batch(void* const* _ptrs, int _n) {
+    if (arena_count <= 1) {
+        myalloc_free_batch(myalloc, _ptrs, _n);
+        return;
+    }
+    // Split the batch by arena, blocks of different arenas can not be coalesced anyway
+    void* local[64];
+    void** ptrs = _n <= 64 ? local : malloc(_n * sizeof(void*));
+    if (ptrs == NULL) {
+        for (int i = 0; i < _n; i++) {
+            deallocate(_ptrs[i]);
+        }
+        return;
+    }
+    for (int a = 0; a < arena_count; a++) {
+        int n = 0;
+        for (int i = 0; i < _n; i++) {
+            if (arena_of(_ptrs[i]) == arenas[a]) {
+                ptrs[n++] = _ptrs[i];
+            }
+        }
+        if (n > 0) {
+            myalloc_free_batch(arenas[a], ptrs, n);
+        }
+    }
+    if (ptrs != local) {
+        free(ptrs);
+    }
+}
+
+/**
+ * Description: Returns the region chunk at _ptr to allocator. region.allocator must be NULL already.
+ */
+static void release_region(struct Myalloc *allocator, void* _ptr) {
+    block_map_set(allocator, _ptr, true);
+    deallocate_block(allocator, _ptr);
+}
+
+/**
+ * Description: Same as region_begin(), the region is carved from _allocator.
+ */
+bool myalloc_region_begin(struct Myalloc* _allocator, size_t _size) {
+    assert(_size > 0);
+    assert(region.allocator == NULL);
+    _size = chunk_size(_allocator, _size);
+
+    pthread_mutex_lock(&_allocator->lock);
+    drain_deferred_frees(_allocator);
+    void* ptr = allocate_chunk(_allocator, _size);
+    // A growable allocator maps more memory when no free chunk is large enough
+    if (ptr == NULL && grow_memory(_allocator, _size)) {
+        ptr = allocate_chunk(_allocator, _size);
+    }
+    if (ptr != NULL) {
+        // pointers into the region are handed out without tags, so compaction must not move it
+        //      - the first block of the region starts at ptr, it leaves the block map so that deallocate(),
+        //        reallocate() and usable_size() on other threads do not take it for the region chunk
+        set_tags(ptr, BLOCK_SIZE(ptr), BLOCK_ALLOCATED | BLOCK_FIXED);
+        block_map_set(_allocator, ptr, false);
+    }
+    pthread_mutex_unlock(&_allocator->lock);
+
+    if (ptr == NULL) {
+        return false;
+    }
+    region.allocator = _allocator;
+    region.start = ptr;
+    region.top = ptr;
+    region.end = (char*)ptr + BLOCK_SIZE(ptr) - CANARY_SIZE;
+    region.last = NULL;
+    return true;
+}
+
+/**
+ * Description: Same as region_reset(), for the region of the calling thread on _allocator.
+ */
+void myalloc_region_reset(struct Myalloc* _allocator) {
+    assert(region.allocator == _allocator);
+    region.top = region.start;
+    region.last = NULL;
+}
+
+/**
+ * Description: Same as region_end(), for the region of the calling thread on _allocator.
+ */
+void myalloc_region_end(struct Myalloc* _allocator) {
+    assert(region.allocator == _allocator);
+    region.allocator = NULL;
+    release_region(_allocator, region.start);
+}
+
+/**
+ * Description: Starts a region of _size bytes for the calling thread. Until region_end(), allocate() on this thread
+ *              returns the next bytes of the region instead of searching the free lists, and deallocate() of a block
+ *              of the region does nothing. The region is one chunk of the memory chunk that compaction does not move.
+ *              Returns false if no free chunk can hold the region.
+ * Precondition: The calling thread has no region
+ */
+bool region_begin(size_t _size) {
+    return myalloc_region_begin(local_arena(), _size);
+}
+
+/**
+ * Description: Releases every block allocated in the region of the calling thread at once, the next allocate()
+ *              starts at the beginning of the region again. Takes constant time and no lock.
+ */
+void region_reset() {
+    myalloc_region_reset(local_arena());
+}
+
+/**
+ * Description: Ends the region of the calling thread and returns its memory to the allocator. Blocks allocated in the
+ *              region must not be used afterwards.
+ */
+void region_end() {
+    myalloc_region_end(local_arena());
+}
+
+/**
+ * Description: Returns the available memory (bytes) of _allocator as an integer
+ */
+size_t myalloc_available_memory(struct Myalloc* _allocator) {
+    // Kept up to date by the free lists, safe to read without the lock
+    return atomic_load_explicit(&_allocator->available_memory, memory_order_relaxed);
+}
+
+/**
+ * Description: Returns the used memory (bytes) of _allocator as an integer
+ */
+size_t myalloc_used_memory(struct Myalloc* _allocator) {
+    // Kept up to date by allocate and deallocate, safe to read without the lock
+    return atomic_load_explicit(&_allocator->used_memory, memory_order_relaxed);
+}
+
+/**
+ * Description: Returns the available memory (bytes) as an integer
+ */
+size_t available_memory() {
+    size_t available = 0;
+    for (int i = 0; i < arena_count; i++) {
+        available += myalloc_available_memory(arenas[i]);
+    }
+    return available;
+}
+
+/**
+ * Description: Returns the used memory (bytes) as an integer
+ */
+size_t used_memory() {
+    size_t used = 0;
+    for (int i = 0; i < arena_count; i++) {
+        used += myalloc_used_memory(arenas[i]);
+    }
+    return used;
+}
+
+/**
+ * Description: Returns true if _allocator has an allocated chunk to the right of a free chunk.
+ *              Free chunks are coalesced with both neighbours on deallocate, so two free chunks
+ *              are always separated by allocated memory and only the first free chunk has to be checked.
+ */
+bool myalloc_is_fragmented(struct Myalloc* _allocator) {
+    pthread_mutex_lock(&_allocator->lock);
+    // Fragmented if the first free chunk is not the last chunk of the memory chunk
+    void* first = first_free_chunk(_allocator);
+    bool fragmented = first != NULL && !is_epilogue(next_block(first));
+    pthread_mutex_unlock(&_allocator->lock);
+    return fragmented;
+}
+
+/**
+ * Description: Returns true if there is fragmentation. False if there is no fragmentation.
+ */
+bool is_fragmented() {
+    for (int i = 0; i < arena_count; i++) {
+        if (myalloc_is_fragmented(arenas[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Description: Same as get_fragmentation_report(), for _allocator.
+ */
+void myalloc_get_fragmentation_report(struct Myalloc* _allocator, struct myalloc_fragmentation_report* _report) {
+    memset(_report, 0, sizeof(*_report));
+
+    pthread_mutex_lock(&_allocator->lock);
+    // Walk every chunk in address order, only reading the tags
+    //      - chunks in thread caches, slabs and regions are tagged allocated and counted as allocated chunks
+    for (void* block = _allocator->memory; !is_epilogue(block); block = next_block(block)) {
+        size_t size = BLOCK_SIZE(block);
+        if (is_allocated(block)) {
+            _report->allocated_chunks++;
+            _report->allocated_size += size;
+            _report->allocated_histogram[size_class(size)]++;
+        } else {
+            _report->free_chunks++;
+            _report->free_size += size;
+            _report->free_histogram[size_class(size)]++;
+            if (size > _report->largest_free_chunk_size) {
+                _report->largest_free_chunk_size = size;
+            }
+        }
+    }
+    pthread_mutex_unlock(&_allocator->lock);
+
+    _report->header_overhead = (size_t)(_report->allocated_chunks + _report->free_chunks) * (HEADER_SIZE + FOOTER_SIZE);
+    if (_report->free_size != 0) {
+        _report->largest_free_ratio = (double)_report->largest_free_chunk_size / _report->free_size;
+        _report->external_fragmentation = 1.0 - _report->largest_free_ratio;
+    }
+}
+
+/**
+ * Description: Fills _report with the fragmentation of the memory chunk: the free memory and how much of it the
+ *              largest free chunk holds, histograms of the free and allocated chunk sizes and the bytes taken by
+ *              the boundary tags. Nothing is changed, so it is safe to call from a monitoring thread. It walks every
+ *              chunk under the lock, so it takes time linear in the number of chunks.
+ */
+void get_fragmentation_report(struct myalloc_fragmentation_report* _report) {
+    myalloc_get_fragmentation_report(myalloc, _report);
+    // With MYALLOC_NUMA the report covers every arena, a free chunk never spans two arenas
+    for (int i = 0; i < arena_count; i++) {
+        if (arenas[i] == myalloc) {
+            continue;
+        }
+        struct myalloc_fragmentation_report report;
+        myalloc_get_fragmentation_report(arenas[i], &report);
+        _report->free_size += report.free_size;
+        _report->free_chunks += report.free_chunks;
+        if (report.largest_free_chunk_size > _report->largest_free_chunk_size) {
+            _report->largest_free_chunk_size = report.largest_free_chunk_size;
+        }
+        _report->allocated_size += report.allocated_size;
+        _report->allocated_chunks += report.allocated_chunks;
+        _report->header_overhead += report.header_overhead;
+        for (int bin = 0; bin < MYALLOC_HISTOGRAM_BINS; bin++) {
+            _report->free_histogram[bin] += report.free_histogram[bin];
+            _report->allocated_histogram[bin] += report.allocated_histogram[bin];
+        }
+    }
+    if (arena_count > 1 && _report->free_size != 0) {
+        _report->largest_free_ratio = (double)_report->largest_free_chunk_size / _report->free_size;
+        _report->external_fragmentation = 1.0 - _report->largest_free_ratio;
+    }
+}
+
+/**
+ * Description: Returns true if compaction may move the allocated chunk at block: it is not a fixed chunk and it is not
+ *              the block of a pinned handle.
+ */
+static bool is_movable(struct Myalloc *allocator, void* block) {
+    size_t tag = BLOCK_TAG(block);
+    // chunks in thread caches are allocated but not in the block map, compact_step() leaves the caches alone
+    if ((tag & BLOCK_FIXED) || !is_block(allocator, block)) {
+        return false;
+    }
+    return !(tag & BLOCK_HANDLE) || allocator->handles[HANDLE_INDEX(block)].pins == 0;
+}
+
+/**
+ * Description: Records that the chunk at _before has been moved to _after. The handle table entry of a handle block
+ *              is updated in place, any other chunk is reported through _relocated(_before, _after, _arg).
+ *              Returns true if the move was reported.
+ */
+static bool relocate_chunk(struct Myalloc *allocator, void* _before, void* _after, myalloc_relocation_fn _relocated, void* _arg) {
+    block_map_set(allocator, _before, false);
+    block_map_set(allocator, _after, true);
+    if (BLOCK_TAG(_after) & BLOCK_HANDLE) {
+        allocator->handles[HANDLE_INDEX(_after)].block = _after;
+        return false;
+    }
+    _relocated(_before, _after, _arg);
+    return true;
+}
+
+/**
+ * Description: Slides every movable allocated chunk of allocator towards the start of the memory chunk in one
+ *              address-ordered pass, moving each chunk at most once, and leaves the free memory in one free chunk at
+ *              the end. Chunks from allocate_aligned() and pinned handle blocks stay in place and keep the free memory
+ *              in front of them. Calls _relocated(before, after, _arg) for every moved chunk that is not a handle
+ *              block. Returns the number of reported chunks.
+ *              allocator->lock must be held and the thread caches must be locked and empty.
+ */
+static int slide_chunks(struct Myalloc *allocator, myalloc_relocation_fn _relocated, void* _arg) {
+    // deferred and quarantined blocks are still tagged allocated, they have to be free before anything moves
+    drain_deferred_frees(allocator);
+    flush_quarantine(allocator);
+    int compacted_size = 0;
+    // dest is where the next movable chunk goes, NULL until the first free chunk is found
+    //      - every free chunk before the current one has been taken off the free lists, so moving chunks
+    //        over them does not break the links of the remaining free chunks
+    char* dest = NULL;
+    // the chunks in front of the first free chunk stay where they are
+    void* curr = allocator->address_tree != NULL ? first_free_chunk(allocator) : epilogue_block(allocator);
+    while (!is_epilogue(curr)) {
+        void* next = next_block(curr);
+        if (!is_allocated(curr)) {
+            free_list_remove(allocator, curr);
+            if (dest == NULL) {
+                dest = curr;
+            }
+        } else if (dest != NULL && !is_movable(allocator, curr)) {
+            // the memory between dest and the fixed chunk stays free
+            set_tags(dest, (char*)curr - dest - FOOTER_SIZE - HEADER_SIZE, 0);
+            free_list_insert(allocator, dest);
+            dest = NULL;
+        } else if (dest != NULL) {
+            // move the chunk (with its tags) down to dest via memmove
+            size_t size = BLOCK_SIZE(curr);
+            memmove(dest - HEADER_SIZE, (char*)curr - HEADER_SIZE, HEADER_SIZE + size + FOOTER_SIZE);
+            if (relocate_chunk(allocator, curr, dest, _relocated, _arg)) {
+                compacted_size++;
+            }
+            dest += size + FOOTER_SIZE + HEADER_SIZE;
+        }
+        curr = next;
+    }
+    if (dest != NULL) {
+        // the free memory at the end becomes one chunk ending before the epilogue
+        set_tags(dest, (char*)curr - dest - FOOTER_SIZE - HEADER_SIZE, 0);
+        free_list_insert(allocator, dest);
+    }
+    // a running incremental compaction has nothing left to do
+    allocator->compact_cursor = NULL;
+    return compacted_size;
+}
+
+/**
+ * Description: Continues the incremental compaction of allocator at allocator->compact_cursor, sliding movable chunks
+ *              down like slide_chunks() until about _budget bytes have been moved. The chunk after the last moved one
+ *              becomes free and the cursor is left on it, so the next step continues there.
+ *              Returns false when the step reached the end of the memory chunk.
+ *              allocator->lock must be held, chunks in thread caches are not moved.
+ */
+static bool slide_chunks_step(struct Myalloc *allocator, size_t _budget, myalloc_relocation_fn _relocated, void* _arg) {
+    drain_deferred_frees(allocator);
+    flush_quarantine(allocator);
+    // passing chunks is cheaper than moving them, but it is bounded too: at most as many chunks as the budget could move
+    size_t max_visited = _budget / (HEADER_SIZE + MIN_CHUNK_SIZE + FOOTER_SIZE) + 1;
+    size_t visited = 0;
+    size_t moved_size = 0;
+    int moved_chunks = 0;
+    char* dest = NULL;
+    void* curr = allocator->compact_cursor;
+    if (curr == NULL) {
+        // a new pass starts at the first free chunk
+        curr = allocator->address_tree != NULL ? first_free_chunk(allocator) : epilogue_block(allocator);
+    }
+    while (!is_epilogue(curr) && visited < max_visited) {
+        void* next = next_block(curr);
+        if (!is_allocated(curr)) {
+            free_list_remove(allocator, curr);
+            if (dest == NULL) {
+                dest = curr;
+            }
+        } else if (dest != NULL && !is_movable(allocator, curr)) {
+            // the memory between dest and the fixed chunk stays free
+            set_tags(dest, (char*)curr - dest - FOOTER_SIZE - HEADER_SIZE, 0);
+            free_list_insert(allocator, dest);
+            dest = NULL;
+        } else if (dest != NULL) {
+            // always move one chunk, so every step makes progress
+            size_t size = BLOCK_SIZE(curr);
+            if (moved_chunks > 0 && moved_size + size > _budget) {
+                break;
+            }
+            memmove(dest - HEADER_SIZE, (char*)curr - HEADER_SIZE, HEADER_SIZE + size + FOOTER_SIZE);
+            relocate_chunk(allocator, curr, dest, _relocated, _arg);
+            moved_chunks++;
+            moved_size += size;
+            dest += size + FOOTER_SIZE + HEADER_SIZE;
+        }
+        visited++;
+        curr = next;
+    }
+
+    if (dest != NULL) {
+        // the free memory between dest and curr becomes one chunk, merged with curr if that one is free too
+        size_t size = (char*)curr - dest - FOOTER_SIZE - HEADER_SIZE;
+        if (!is_epilogue(curr) && !is_allocated(curr)) {
+            free_list_remove(allocator, curr);
+            size += FOOTER_SIZE + HEADER_SIZE + BLOCK_SIZE(curr);
+        }
+        set_tags(dest, size, 0);
+        free_list_insert(allocator, dest);
+        curr = dest;
+    }
+    if (is_epilogue(curr) || is_epilogue(next_block(curr))) {
+        allocator->compact_cursor = NULL;
+        return false;
+    }
+    allocator->compact_cursor = curr;
+    return true;
+}
+
+/**
+ * Description: Locks allocator with all its thread caches emptied and runs slide_chunks().
+ */
+static int compact(struct Myalloc *allocator, myalloc_relocation_fn _relocated, void* _arg) {
+    // Chunks sitting in thread caches would move like any allocated chunk, so return them to the free lists
+    // first and keep the caches locked until the chunks are in their final place
+    tcache_lock_all(allocator);
+    pthread_mutex_lock(&allocator->lock);
+
+    int compacted_size = slide_chunks(allocator, _relocated, _arg);
+    // compaction moved all free memory to the end of the memory chunk
+    trim_memory(allocator);
+
+    pthread_mutex_unlock(&allocator->lock);
+    tcache_unlock_all(allocator);
+    return compacted_size;
+}
+
+// Relocation callbacks of the compaction functions
+struct relocation_arrays {
+    void** before;
+    void** after;
+    int count;
+};
+
+static void record_relocation_arrays(void* _before, void* _after, void* _arg) {
+    struct relocation_arrays *arrays = _arg;
+    arrays->before[arrays->count] = _before;
+    arrays->after[arrays->count] = _after;
+    arrays->count++;
+}
+
+static void record_relocation_table(void* _before, void* _after, void* _arg) {
+    struct myalloc_relocation **entry = _arg;
+    (*entry)->before = _before;
+    (*entry)->after = _after;
+    (*entry)++;
+}
+
+/**
+ * Description: Same as compact_allocation(), compacts the memory chunk of _allocator.
+ */
+int myalloc_compact(struct Myalloc* _allocator, void** _before, void** _after) {
+    struct relocation_arrays arrays = { .before = _before, .after = _after, .count = 0 };
+    return compact(_allocator, record_relocation_arrays, &arrays);
+}
+
+/**
+ * Description: Compacts the memory chunk of allocator and appends its moves to the *_count entries of the malloc'd
+ *              table *_table (NULL for an empty table), which is grown to hold them.
+ *              Returns false without compacting if the table can not be grown.
+ */
+static bool compact_table_append(struct Myalloc *allocator, struct myalloc_relocation** _table, int* _count) {
+    // no chunk can be allocated while the caches and the lock are held, so the table can be sized up front
+    tcache_lock_all(allocator);
+    pthread_mutex_lock(&allocator->lock);
+
+    int allocated_chunks = atomic_load_explicit(&allocator->allocated_chunks, memory_order_relaxed);
+    struct myalloc_relocation *table = realloc(*_table, (*_count + (allocated_chunks > 0 ? allocated_chunks : 1)) * sizeof(struct myalloc_relocation));
+    if (table != NULL) {
+        *_table = table;
+        struct myalloc_relocation *entry = table + *_count;
+        *_count += slide_chunks(allocator, record_relocation_table, &entry);
+        trim_memory(allocator);
+    }
+
+    pthread_mutex_unlock(&allocator->lock);
+    tcache_unlock_all(allocator);
+    return table != NULL;
+}
+
+/**
+ * Description: Same as compact_allocation_table(), compacts the memory chunk of _allocator.
+ */
+struct myalloc_relocation* myalloc_compact_table(struct Myalloc* _allocator, int* _count) {
+    struct myalloc_relocation *table = NULL;
+    *_count = 0;
+    compact_table_append(_allocator, &table, _count);
+    return table;
+}
+
+/**
+ * Description: Same as compact_step(), for _allocator.
+ */
+bool myalloc_compact_step(struct Myalloc* _allocator, size_t _budget, myalloc_relocation_fn _relocated, void* _arg) {
+    // only allocator->lock, a step passes cached chunks like fixed ones instead of emptying every thread's cache
+    pthread_mutex_lock(&_allocator->lock);
+
+    bool more = slide_chunks_step(_allocator, _budget, _relocated, _arg);
+    if (!more) {
+        trim_memory(_allocator);
+    }
+
+    pthread_mutex_unlock(&_allocator->lock);
+    return more;
+}
+
+/**
+ * Description: Compaction will be performed by grouping the allocated memory blocks in the beginning of the memory
+ *              chunk and combining the free memory at the end of the memory chunk.
+ *              Every allocated block is moved at most once, so _before and _after need room for as many entries
+ *              as there are allocated chunks (see get_statistics()).
+ *              The return value is an integer which is the total number of pointers inserted in the _before/_after array.
+ */
+int compact_allocation(void** _before, void** _after) {
+    int count = 0;
+    for (int i = 0; i < arena_count; i++) {
+        count += myalloc_compact(arenas[i], _before + count, _after + count);
+    }
+    return count;
+}
+
+/**
+ * Description: Same as compact_allocation(), but returns the moved blocks in a table allocated with malloc that
+ *              has room for every allocated block, so the caller does not have to guess an array size.
+ *              *_count is set to the number of entries filled in. The caller frees the table with free().
+ *              Returns NULL (and sets *_count to 0) without compacting if the table can not be allocated.
+ */
+struct myalloc_relocation* compact_allocation_table(int* _count) {
+    struct myalloc_relocation *table = NULL;
+    *_count = 0;
+    // with MYALLOC_NUMA the arenas after one whose moves do not fit are left as they are
+    for (int i = 0; i < arena_count && compact_table_append(arenas[i], &table, _count); i++) {
+    }
+    return table;
+}
+
+/**
+ * Description: Performs a bounded part of a compaction, so compaction can be spread over many calls that each hold
+ *              the allocator lock for a short time. A step moves blocks until about _budget bytes have been moved
+ *              (at least one block), and calls _relocated(before, after, _arg) for every moved block.
+ *              Allocations and deallocations can happen between steps. Returns true while the compaction has more
+ *              to do, false once it has reached the end of the memory chunk.
+ */
+bool compact_step(size_t _budget, myalloc_relocation_fn _relocated, void* _arg) {
+    // with MYALLOC_NUMA every arena takes a step of its own
+    bool more = false;
+    for (int i = 0; i < arena_count; i++) {
+        more = myalloc_compact_step(arenas[i], _budget, _relocated, _arg) || more;
+    }
+    return more;
+}
+
+/**
+ * Description: Takes a free entry off the handle table of allocator, doubling the table when it is full.
+ *              Returns -1 if the table can not be grown.
+ *              allocator->lock must be held.
+ */
+static int handle_entry_acquire(struct Myalloc *allocator) {
+    if (allocator->first_free_handle == -1) {
+        int capacity = allocator->handle_capacity > 0 ? allocator->handle_capacity * 2 : HANDLE_TABLE_MIN;
+        struct handle_entry *handles = realloc(allocator->handles, capacity * sizeof(struct handle_entry));
+        if (handles == NULL) {
+            return -1;
+        }
+        // link the new entries in index order, so low handles are reused first
+        for (int i = allocator->handle_capacity; i < capacity; i++) {
+            handles[i].block = NULL;
+            handles[i].pins = 0;
+            handles[i].next_free = i + 1 < capacity ? i + 1 : -1;
+        }
+        allocator->first_free_handle = allocator->handle_capacity;
+        allocator->handles = handles;
+        allocator->handle_capacity = capacity;
+    }
+    int handle = allocator->first_free_handle;
+    allocator->first_free_handle = allocator->handles[handle].next_free;
+    return handle;
+}
+
+/**
+ * Description: Same as allocate_handle(), served from _allocator.
+ */
+int myalloc_alloc_handle(struct Myalloc* _allocator, size_t _size) {
+    assert(_size > 0);
+    // the handle table is not part of a persistent memory chunk
+    if (_allocator->magic == PERSISTENT_MAGIC) {
+        report_error("Handles can not be allocated from a persistent allocator.\n");
+        return -1;
+    }
+    // the handle index is stored behind the caller's data
+    _size = chunk_size(_allocator, _size + HANDLE_INDEX_SIZE);
+
+    // Handle blocks bypass the thread caches: the block must be tagged before compaction can see it
+    pthread_mutex_lock(&_allocator->lock);
+    drain_deferred_frees(_allocator);
+
+    void* ptr = allocate_chunk(_allocator, _size);
+    // A growable allocator maps more memory when no free chunk is large enough
+    if (ptr == NULL && grow_memory(_allocator, _size)) {
+        ptr = allocate_chunk(_allocator, _size);
+    }
+    if (ptr == NULL) {
+        pthread_mutex_unlock(&_allocator->lock);
+        return -1;
+    }
+
+    int handle = handle_entry_acquire(_allocator);
+    if (handle == -1) {
+        deallocate_chunk(_allocator, ptr);
+        pthread_mutex_unlock(&_allocator->lock);
+        return -1;
+    }
+    _allocator->handles[handle].block = ptr;
+    _allocator->handles[handle].pins = 0;
+    set_tags(ptr, BLOCK_SIZE(ptr), BLOCK_ALLOCATED | BLOCK_HANDLE);
+    HANDLE_INDEX(ptr) = handle;
+
+    pthread_mutex_unlock(&_allocator->lock);
+    return handle;
+}
+
+/**
+ * Description: Same as handle_pin(), for a handle of _allocator.
+ */
+void* myalloc_handle_pin(struct Myalloc* _allocator, int _handle) {
+    pthread_mutex_lock(&_allocator->lock);
+    assert(_handle >= 0 && _handle < _allocator->handle_capacity && _allocator->handles[_handle].block != NULL);
+    struct handle_entry *entry = &_allocator->handles[_handle];
+    entry->pins++;
+    void* ptr = entry->block;
+    pthread_mutex_unlock(&_allocator->lock);
+    return ptr;
+}
+
+/**
+ * Description: Same as handle_unpin(), for a handle of _allocator.
+ */
+void myalloc_handle_unpin(struct Myalloc* _allocator, int _handle) {
+    pthread_mutex_lock(&_allocator->lock);
+    assert(_handle >= 0 && _handle < _allocator->handle_capacity && _allocator->handles[_handle].pins > 0);
+    _allocator->handles[_handle].pins--;
+    pthread_mutex_unlock(&_allocator->lock);
+}
+
+/**
+ * Description: Same as deallocate_handle(), for a handle of _allocator.
+ */
+void myalloc_free_handle(struct Myalloc* _allocator, int _handle) {
+    pthread_mutex_lock(&_allocator->lock);
+    assert(_handle >= 0 && _handle < _allocator->handle_capacity && _allocator->handles[_handle].block != NULL);
+    struct handle_entry *entry = &_allocator->handles[_handle];
+    assert(entry->pins == 0);
+    void* ptr = entry->block;
+    entry->block = NULL;
+    entry->next_free = _allocator->first_free_handle;
+    _allocator->first_free_handle = _handle;
+
+    check_chunk(ptr);
+    deallocate_chunk(_allocator, ptr);
+    trim_memory(_allocator);
+
+    pthread_mutex_unlock(&_allocator->lock);
+}
+
+/**
+ * Description: Allocates a movable block of size _size and returns a handle to it, or -1 if allocation cannot be
+ *              satisfied. The handle stays valid until deallocate_handle(), while compaction is free to move the
+ *              block and updates the handle instead of reporting the move.
+ *              With MYALLOC_NUMA the handles come from the arena of the thread that called initialize_allocator().
+ */
+int allocate_handle(size_t _size) {
+    return myalloc_alloc_handle(myalloc, _size);
+}
+
+/**
+ * Description: Returns the current address of the block of _handle and pins it, so compaction does not move it
+ *              until the matching handle_unpin(). Pins nest, the block stays in place until every pin is released.
+ */
+void* handle_pin(int _handle) {
+    return myalloc_handle_pin(myalloc, _handle);
+}
+
+/**
+ * Description: Releases one pin of _handle taken by handle_pin(). The address returned by handle_pin() must not be
+ *              used once the last pin is released.
+ */
+void handle_unpin(int _handle) {
+    myalloc_handle_unpin(myalloc, _handle);
+}
+
+/**
+ * Description: Returns the block of _handle back to the allocator and releases the handle.
+ * Precondition: _handle was returned by allocate_handle(), is not pinned and has not been deallocated
+ */
+void deallocate_handle(int _handle) {
+    myalloc_free_handle(myalloc, _handle);
+}
+
+/**
+ * Description: Returns the smallest (or largest) free chunk size, 0 if there are no free chunks.
+ *              The size tree keeps its smallest and largest chunk, with SEGREGATED_FIT only the lowest (or highest)
+ *              non-empty bin has to be scanned. allocator->lock must be held.
+ */
+static size_t free_chunk_extreme(struct Myalloc *allocator, bool largest) {
+    if (allocator->aalgorithm != SEGREGATED_FIT) {
+        void* extreme = largest ? allocator->largest_free : allocator->smallest_free;
+        return extreme != NULL ? BLOCK_SIZE(extreme) : 0;
+    }
+    if (allocator->bin_bitmap == 0) {
+        return 0;
+    }
+    void* curr = allocator->bins[largest ? 63 - __builtin_clzll(allocator->bin_bitmap) : __builtin_ctzll(allocator->bin_bitmap)];
+    size_t extreme = 0;
+    for (; curr != NULL; curr = link_get(&FREE_LINKS(curr)->next)) {
+        size_t curr_size = BLOCK_SIZE(curr);
+        if (extreme == 0 || (largest ? curr_size > extreme : curr_size < extreme)) {
+            extreme = curr_size;
+        }
+    }
+    return extreme;
+}
+
+/**
+ * Description: Same as get_statistics(), for _allocator.
+ */
+void myalloc_get_statistics(struct Myalloc* _allocator, struct myalloc_stats* _stats) {
+    _stats->allocated_chunks = atomic_load_explicit(&_allocator->allocated_chunks, memory_order_relaxed);
+    _stats->used_size = myalloc_used_memory(_allocator);
+    _stats->free_size = myalloc_available_memory(_allocator);
+    _stats->free_chunks = atomic_load_explicit(&_allocator->free_chunks, memory_order_relaxed);
+
+    pthread_mutex_lock(&_allocator->lock);
+    // the size of a growable allocator changes with allocate and deallocate
+    _stats->allocated_size = _allocator->size;
+    _stats->largest_free_chunk_size = free_chunk_extreme(_allocator, true);
+    _stats->smallest_free_chunk_size = free_chunk_extreme(_allocator, false);
+    pthread_mutex_unlock(&_allocator->lock);
+}
+
+/**
+ * Description: Fills _stats with the fields printed by print_statistics().
+ *              The sizes and chunk counts are read without the lock. Only the largest and smallest free chunk
+ *              sizes take the lock, and they scan one list at most.
+ */
+void get_statistics(struct myalloc_stats* _stats) {
+    myalloc_get_statistics(myalloc, _stats);
+    // With MYALLOC_NUMA the statistics add up the arenas
+    for (int i = 0; i < arena_count; i++) {
+        if (arenas[i] == myalloc) {
+            continue;
+        }
+        struct myalloc_stats stats;
+        myalloc_get_statistics(arenas[i], &stats);
+        _stats->allocated_size += stats.allocated_size;
+        _stats->allocated_chunks += stats.allocated_chunks;
+        _stats->used_size += stats.used_size;
+        _stats->free_size += stats.free_size;
+        _stats->free_chunks += stats.free_chunks;
+        if (stats.largest_free_chunk_size > _stats->largest_free_chunk_size) {
+            _stats->largest_free_chunk_size = stats.largest_free_chunk_size;
+        }
+        if (stats.smallest_free_chunk_size != 0 &&
+            (_stats->smallest_free_chunk_size == 0 || stats.smallest_free_chunk_size < _stats->smallest_free_chunk_size)) {
+            _stats->smallest_free_chunk_size = stats.smallest_free_chunk_size;
+        }
+    }
+}
+
+/**
+ * Description: Prints the fields of _stats
+ */
+static void print_stats(const struct myalloc_stats* _stats) {
+    printf("Allocated size = %zu\n", _stats->allocated_size);
+    printf("Allocated chunks = %d\n", _stats->allocated_chunks);
+    printf("Free size = %zu\n", _stats->free_size);
+    printf("Free chunks = %d\n", _stats->free_chunks);
+    printf("Largest free chunk size = %zu\n", _stats->largest_free_chunk_size);
+    printf("Smallest free chunk size = %zu\n", _stats->smallest_free_chunk_size);
+}
+
+/**
+ * Description: Prints the statistics of _allocator
+ */
+void myalloc_print_statistics(struct Myalloc* _allocator) {
+    struct myalloc_stats stats;
+    myalloc_get_statistics(_allocator, &stats);
+    print_stats(&stats);
+}
+
+/**
+ * Description: Prints the statistics of the memory allocator
+ */
+void print_statistics() {
+    struct myalloc_stats stats;
+    get_statistics(&stats);
+    print_stats(&stats);
+}
+
+#ifdef MYALLOC_TRACE
+/**
+ * Description: Same as set_trace(), for the calls on _allocator. Returns false and changes nothing if _fn is not NULL
+ *              and _allocator is shared, since other processes can not call a function of this one; the trace ring of
+ *              a shared allocator is shared too, any process can drain it.
+ */
+bool myalloc_set_trace(struct Myalloc* _allocator, unsigned _period, myalloc_trace_fn _fn, void* _arg) {
+    if (_fn != NULL && _allocator->shared) {
+        report_error("Error: a shared allocator can not call a trace callback.\n");
+        return false;
+    }
+    atomic_store_explicit(&_allocator->trace_arg, _arg, memory_order_relaxed);
+    atomic_store_explicit(&_allocator->trace_fn, _fn, memory_order_relaxed);
+    atomic_store_explicit(&_allocator->trace_period, _period, memory_order_release);
+    return true;
+}
+
+/**
+ * Description: Same as trace_drain(), for the trace ring of _allocator.
+ */
+int myalloc_trace_drain(struct Myalloc* _allocator, struct myalloc_trace_event* _events, int _max) {
+    struct trace_ring *ring = _allocator->trace_ring;
+    int count = 0;
+    while (count < _max) {
+        size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        struct trace_slot *slot = &ring->slots[pos % TRACE_RING_SIZE];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)(sequence - (pos + 1));
+        if (diff < 0) {
+            // the event at pos has not been written yet
+            break;
+        }
+        if (diff == 0 && atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1, memory_order_relaxed,
+                                                               memory_order_relaxed)) {
+            _events[count++] = slot->event;
+            atomic_store_explicit(&slot->sequence, pos + TRACE_RING_SIZE, memory_order_release);
+        }
+    }
+    return count;
+}
+
+/**
+ * Description: Same as trace_dropped(), for the trace ring of _allocator.
+ */
+size_t myalloc_trace_dropped(struct Myalloc* _allocator) {
+    return atomic_load_explicit(&_allocator->trace_ring->dropped, memory_order_relaxed);
+}
+
+/**
+ * Description: Samples every _period-th allocate(), allocate_aligned(), deallocate() and reallocate() call of each
+ *              thread, 0 turns sampling off. A sampled call is written to a lock-free ring of 4096 events that
+ *              trace_drain() reads, and passed to _fn(event, _arg) right after the call if _fn is not NULL.
+ *              The event holds the block, the size, the return address of the call and its latency.
+ *              Only built with -DMYALLOC_TRACE, otherwise the calls carry no tracing code at all.
+ * Precondition: A callback that is replaced while other threads allocate may still be called once for a call that
+ *               was in flight, with either argument
+ */
+void set_trace(unsigned _period, myalloc_trace_fn _fn, void* _arg) {
+    for (int i = 0; i < arena_count; i++) {
+        myalloc_set_trace(arenas[i], _period, _fn, _arg);
+    }
+}
+
+/**
+ * Description: Moves up to _max of the oldest recorded events from the trace ring to _events and returns how many
+ *              were moved. Any thread can drain the ring while others allocate.
+ */
+int trace_drain(struct myalloc_trace_event* _events, int _max) {
+    int count = 0;
+    for (int i = 0; i < arena_count; i++) {
+        count += myalloc_trace_drain(arenas[i], _events + count, _max - count);
+    }
+    return count;
+}
+
+/**
+ * Description: Returns the number of sampled events that were lost because the trace ring was full.
+ */
+size_t trace_dropped() {
+    size_t dropped = 0;
+    for (int i = 0; i < arena_count; i++) {
+        dropped += myalloc_trace_dropped(arenas[i]);
+    }
+    return dropped;
+}
+#endif
+
+/**
+ * Description: Same as prefork(), for _allocator.
+ */
+void myalloc_prefork(struct Myalloc* _allocator) {
+    pthread_mutex_lock(&tcache_registry_lock);
+    pthread_mutex_lock(&_allocator->lock);
+}
+
+/**
+ * Description: Same as postfork(), for _allocator.
+ */
+void myalloc_postfork(struct Myalloc* _allocator) {
+    pthread_mutex_unlock(&_allocator->lock);
+    pthread_mutex_unlock(&tcache_registry_lock);
+}
+
+/**
+ * Description: Takes the locks of the allocator so that fork() does not copy it in the middle of an operation of
+ *              another thread. Meant for pthread_atfork(): call prefork() before fork() and postfork() after it in
+ *              both the parent and the child. Chunks in the caches of the threads that do not exist in the child stay
+ *              allocated in the child.
+ */
+void prefork() {
+    pthread_mutex_lock(&tcache_registry_lock);
+    for (int i = 0; i < arena_count; i++) {
+        pthread_mutex_lock(&arenas[i]->lock);
+    }
+}
+
+/**
+ * Description: Releases the locks taken by prefork().
+ */
+void postfork() {
+    for (int i = arena_count - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&arenas[i]->lock);
+    }
+    pthread_mutex_unlock(&tcache_registry_lock);
+}
+
+/**
+ * Description: Releases _allocator and its memory chunk. Pointers returned by _allocator must not be used afterwards.
+ *              A persistent allocator is written back to its file and closed instead, its blocks stay allocated.
+ *              A shared allocator is only unmapped from the calling process.
+ */
+void myalloc_destroy(struct Myalloc* _allocator) {
+    bool persistent = _allocator->magic == PERSISTENT_MAGIC;
+    // the region of the calling thread goes away with the memory chunk
+    if (region.allocator == _allocator) {
+        region.allocator = NULL;
+        if (persistent) {
+            release_region(_allocator, region.start);
+        }
+    }
+    if (persistent && _allocator->shared) {
+        // Other processes keep using the allocator, its lock and its trace ring
+        munmap(_allocator, _allocator->reserved_size);
+        return;
+    }
+    if (persistent) {
+        // Blocks only this process knows about go back to the free lists before the memory chunk outlives it
+        tcache_lock_all(_allocator);
+        pthread_mutex_lock(&_allocator->lock);
+        drain_deferred_frees(_allocator);
+        flush_quarantine(_allocator);
+        pthread_mutex_unlock(&_allocator->lock);
+        tcache_unlock_all(_allocator);
+    }
+    // Chunks left in thread caches belong to the memory chunk we are about to free
+    pthread_mutex_lock(&tcache_registry_lock);
+    while (_allocator->thread_caches != NULL) {
+        struct thread_cache *cache = _allocator->thread_caches;
+        pthread_mutex_lock(&cache->lock);
+        tcache_unregister(cache);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    pthread_mutex_unlock(&tcache_registry_lock);
+
+    pthread_mutex_destroy(&_allocator->lock);
+    free(_allocator->handles);
+    if (persistent) {
+        // the side maps are part of the file, a clean close lets the next myalloc_open() map it again
+        int file = _allocator->file;
+        size_t size = _allocator->reserved_size;
+        _allocator->in_use = false;
+        msync(_allocator, size, MS_SYNC);
+        munmap(_allocator, size);
+        if (file != -1) {
+            close(file);
+        }
+        return;
+    }
+    free(_allocator->slab_pagemap);
+#ifdef MYALLOC_TRACE
+    free(_allocator->trace_ring);
+#endif
+    if (_allocator->block_map != NULL) {
+        munmap(_allocator->block_map, _allocator->block_map_size);
+    }
+    // the allocator, its free lists and its slabs live inside the memory chunk, the handle table and the side maps
+    // are the only other allocations
+    if (_allocator->reserved_size != 0) {
+        munmap(_allocator, _allocator->reserved_size);
+    } else {
+        free(_allocator);
+    }
+}
+
+/**
+ * Description: Releases any dynamically allocated memory in your contiguous allocator.
+ */
+void destroy_allocator() {
+    for (int i = 0; i < arena_count; i++) {
+        myalloc_destroy(arenas[i]);
+    }
+    arena_count = 0;
+    myalloc = NULL;
+}
@@ -9,8 +9,250 @@
 #ifndef __MYALLOC_H__
 #define __MYALLOC_H__
 #include <stdbool.h>
+#include <stddef.h>
 
-enum allocation_algorithm {FIRST_FIT, BEST_FIT, WORST_FIT};
+// SEGREGATED_FIT keeps the free chunks in power-of-two size-class bins and returns the best of the first few chunks
+// of the request's own bin that fit, or else the first chunk of the next non-empty bin, in constant time
+enum allocation_algorithm {FIRST_FIT, BEST_FIT, WORST_FIT, SEGREGATED_FIT};
+
+// MYALLOC_THREAD_CACHE serves requests of up to about 256 bytes (16 size classes 16 bytes or the minimum alignment
+// apart, starting at the smallest chunk) from per-thread caches of recently freed chunks,
+// which are refilled from and flushed to the shared memory chunk in batches. Cached chunks count as used memory.
+// MYALLOC_GROWABLE maps more memory with mmap when no free chunk is large enough, up to MYALLOC_MAX_SIZE bytes,
+// and gives free memory at the end of the memory chunk back to the system. _size is the initial size, rounded up
+// to whole pages, and the memory chunk never shrinks below it.
+// By default the memory chunk is pre-faulted with memset. MYALLOC_LAZY_FAULT maps it with mmap instead and lets
+// the pages fault in on first use, which makes initialization of large memory chunks fast.
+// MYALLOC_HUGE_PAGES maps the memory chunk from the huge page pool (MAP_HUGETLB) and falls back to transparent
+// huge pages when the pool has no free huge pages, MYALLOC_TRANSPARENT_HUGE_PAGES only uses transparent huge pages
+// (madvise(MADV_HUGEPAGE)). Growable allocators always use transparent huge pages.
+// MYALLOC_SLABS serves requests of up to 128 bytes from 16 KB slabs of 16, 32, 64 or 128-byte slots without
+// boundary tags. A slab counts as one allocated chunk, and slots are never moved by compaction.
+// MYALLOC_DEFERRED_FREE makes deallocations from threads other than the owner (see set_owner()) lock-free: the block
+// is pushed on a stack with a CAS and returned to the free lists by the next allocation. Deferred blocks count as
+// used memory until then.
+// MYALLOC_NUMA makes initialize_allocator_with_flags() create one arena of _size bytes per NUMA node, bound to the
+// memory of its node. allocate() is served from the arena of the node the calling thread runs on, and deallocate()
+// returns a block to the arena it came from. It has no effect on myalloc_create(), see MYALLOC_NUMA_NODE().
+enum allocator_flags {MYALLOC_THREAD_CACHE = 0x1, MYALLOC_GROWABLE = 0x2, MYALLOC_LAZY_FAULT = 0x4,
+                      MYALLOC_HUGE_PAGES = 0x8, MYALLOC_TRANSPARENT_HUGE_PAGES = 0x10, MYALLOC_SLABS = 0x20,
+                      MYALLOC_DEFERRED_FREE = 0x40, MYALLOC_NUMA = 0x80};
+
+// Largest memory chunk of a MYALLOC_GROWABLE allocator, its address space is reserved up front
+#define MYALLOC_MAX_SIZE ((size_t)64 << 30)
+
+// MYALLOC_MIN_ALIGNMENT(alignment) can be added to the flags to align every block to alignment bytes (a power of two
+// from 8 to 4096, the default is 8). Chunks are padded so the next chunk starts aligned as well.
+#define MYALLOC_MIN_ALIGNMENT(alignment) (__builtin_ctz(alignment) << 8)
+
+// MYALLOC_NUMA_NODE(node) can be added to the flags of myalloc_create() to bind the memory chunk to a NUMA node with
+// mbind(). The memory chunk is mmap'd and pre-faulted from a thread running on the node, so the pages are local to the
+// node even where the binding is not allowed.
+#define MYALLOC_NUMA_NODE(node) (((node) + 1) << 16)
+
+// Most NUMA nodes the default allocator keeps an arena for
+#define MYALLOC_MAX_NUMA_NODES 64
+
+// Handle to an allocator created with myalloc_create(). The functions without a handle
+// (initialize_allocator(), allocate(), ...) use the allocator set up by initialize_allocator().
+struct Myalloc;
+
+/**
+ * Description: Creates an allocator serving requests from its own memory chunk of _size bytes, rounded up to the
+ *              nearest next 64-byte boundary like initialize_allocator(). Each allocator has its own lock, free lists,
+ *              statistics and thread caches, so allocators can be used at the same time without contending.
+ *              _flags is a combination of enum allocator_flags.
+ *              Returns NULL if the memory chunk can not be allocated.
+ */
+struct Myalloc* myalloc_create(size_t _size, enum allocation_algorithm _aalgorithm, int _flags);
+
+/**
+ * Description: Opens the persistent allocator in the file at _path, so the blocks of a process survive a restart.
+ *              An empty or new file gets a memory chunk of _size bytes like myalloc_create(). A file written before
+ *              is mapped again with the size, algorithm and flags it was created with, _size, _aalgorithm and _flags
+ *              are ignored then. It may be mapped at another address, see set_root().
+ *              myalloc_destroy() writes the memory chunk back to the file and closes it.
+ *              MYALLOC_GROWABLE is not supported, the page fault and NUMA flags are ignored and handles can not be
+ *              allocated. Only one process can have the file open at a time.
+ *              Returns NULL if the file can not be opened or holds no allocator that was closed cleanly.
+ */
+struct Myalloc* myalloc_open(const char* _path, size_t _size, enum allocation_algorithm _aalgorithm, int _flags);
+
+/**
+ * Description: Same as set_root(), for _allocator.
+ */
+void myalloc_set_root(struct Myalloc* _allocator, void* _ptr);
+
+/**
+ * Description: Same as get_root(), for _allocator.
+ */
+void* myalloc_get_root(struct Myalloc* _allocator);
+
+/**
+ * Description: Creates an allocator of _size bytes in the new POSIX shared memory object _name (see shm_open()), which
+ *              other processes map with myalloc_shm_attach(). Blocks allocated by any process can be freed by any
+ *              other, the allocator lock is a PTHREAD_PROCESS_SHARED mutex. Blocks are passed between processes as
+ *              offsets, see myalloc_to_offset(). MYALLOC_GROWABLE is not supported, thread caches, the page fault
+ *              and NUMA flags are ignored and handles can not be allocated.
+ *              myalloc_destroy() unmaps the allocator from the calling process, the object is removed with
+ *              shm_unlink(_name) once no other process has to attach to it.
+ *              Returns NULL if the object already exists or can not be created.
+ */
+struct Myalloc* myalloc_shm_create(const char* _name, size_t _size, enum allocation_algorithm _aalgorithm, int _flags);
+
+/**
+ * Description: Maps the shared allocator in the shared memory object _name, created by myalloc_shm_create() in
+ *              another process. The allocator keeps pointers to its own memory, so it is mapped at the same address
+ *              in every process. Returns NULL if the object does not hold a shared allocator or that address is taken.
+ */
+struct Myalloc* myalloc_shm_attach(const char* _name);
+
+/**
+ * Description: Same as to_offset(), for a block of _allocator.
+ */
+size_t myalloc_to_offset(struct Myalloc* _allocator, void* _ptr);
+
+/**
+ * Description: Same as from_offset(), for a block of _allocator.
+ */
+void* myalloc_from_offset(struct Myalloc* _allocator, size_t _offset);
+
+/**
+ * Description: Same as allocate(), served from _allocator.
+ */
+void* myalloc_alloc(struct Myalloc* _allocator, size_t _size);
+
+/**
+ * Description: Same as allocate_aligned(), served from _allocator.
+ */
+void* myalloc_alloc_aligned(struct Myalloc* _allocator, size_t _size, size_t _alignment);
+
+/**
+ * Description: Same as deallocate(), returns the chunk back to _allocator.
+ * Precondition: The pointer was returned by myalloc_alloc() on _allocator and is still allocated.
+ */
+void myalloc_free(struct Myalloc* _allocator, void* _ptr);
+
+/**
+ * Description: Same as reallocate(), for a block of _allocator.
+ * Precondition: The pointer is NULL or was returned by myalloc_alloc() on _allocator and is still allocated.
+ */
+void* myalloc_realloc(struct Myalloc* _allocator, void* _ptr, size_t _size);
+
+/**
+ * Description: Same as contains(), for the memory chunk of _allocator.
+ */
+bool myalloc_contains(struct Myalloc* _allocator, void* _ptr);
+
+/**
+ * Description: Same as usable_size(), for a block of _allocator.
+ */
+size_t myalloc_usable_size(struct Myalloc* _allocator, void* _ptr);
+
+/**
+ * Description: Same as allocate_batch(), served from _allocator.
+ */
+int myalloc_alloc_batch(struct Myalloc* _allocator, const size_t* _sizes, int _n, void** _out);
+
+/**
+ * Description: Same as deallocate_batch(), returns the chunks back to _allocator.
+ */
+void myalloc_free_batch(struct Myalloc* _allocator, void* const* _ptrs, int _n);
+
+/**
+ * Description: Same as region_begin(), the region is carved from _allocator.
+ */
+bool myalloc_region_begin(struct Myalloc* _allocator, size_t _size);
+
+/**
+ * Description: Same as region_reset(), for the region of the calling thread on _allocator.
+ */
+void myalloc_region_reset(struct Myalloc* _allocator);
+
+/**
+ * Description: Same as region_end(), for the region of the calling thread on _allocator.
+ */
+void myalloc_region_end(struct Myalloc* _allocator);
+
+/**
+ * Description: Returns the available memory (bytes) of _allocator as an integer.
+ */
+size_t myalloc_available_memory(struct Myalloc* _allocator);
+
+/**
+ * Description: Returns the used memory (bytes) of _allocator as an integer.
+ */
+size_t myalloc_used_memory(struct Myalloc* _allocator);
+
+/**
+ * Description: Prints the statistics of _allocator.
+ */
+void myalloc_print_statistics(struct Myalloc* _allocator);
+
+/**
+ * Description: Returns true if _allocator has an allocated chunk to the right of a free chunk.
+ */
+bool myalloc_is_fragmented(struct Myalloc* _allocator);
+
+// Number of bins of the size histograms of a fragmentation report, bin i counts chunks of 2^i to 2^(i+1) - 1 bytes
+#define MYALLOC_HISTOGRAM_BINS 64
+
+// Fragmentation of the memory chunk, see get_fragmentation_report()
+struct myalloc_fragmentation_report {
+    size_t free_size;
+    int free_chunks;
+    size_t largest_free_chunk_size;
+    double external_fragmentation;  // 1 - largest free chunk / free memory, 0 when nothing is free
+    double largest_free_ratio;      // largest free chunk / free memory, 0 when nothing is free
+    size_t allocated_size;
+    int allocated_chunks;
+    size_t header_overhead;         // bytes taken by the header and footer of every chunk
+    size_t free_histogram[MYALLOC_HISTOGRAM_BINS];
+    size_t allocated_histogram[MYALLOC_HISTOGRAM_BINS];
+};
+
+/**
+ * Description: Same as get_fragmentation_report(), for _allocator.
+ */
+void myalloc_get_fragmentation_report(struct Myalloc* _allocator, struct myalloc_fragmentation_report* _report);
+
+/**
+ * Description: Same as compact_allocation(), compacts the memory chunk of _allocator.
+ */
+int myalloc_compact(struct Myalloc* _allocator, void** _before, void** _after);
+
+/**
+ * Description: Releases _allocator and its memory chunk. Pointers returned by _allocator must not be used afterwards.
+ *              A persistent allocator is written back to its file and closed instead, its blocks stay allocated.
+ *              A shared allocator is only unmapped from the calling process.
+ */
+void myalloc_destroy(struct Myalloc* _allocator);
+
+/**
+ * Description: Same as set_owner(), for _allocator.
+ */
+void myalloc_set_owner(struct Myalloc* _allocator);
+
+/**
+ * Description: Same as prefork(), for _allocator.
+ */
+void myalloc_prefork(struct Myalloc* _allocator);
+
+/**
+ * Description: Same as postfork(), for _allocator.
+ */
+void myalloc_postfork(struct Myalloc* _allocator);
+
+/**
+ * Description: Returns the number of NUMA nodes of the system, 1 if it has no NUMA topology.
+ */
+int myalloc_numa_nodes();
+
+/**
+ * Description: Returns the NUMA node the calling thread runs on. The node is looked up again every 256 calls, so a
+ *              thread that moves to another node is noticed after a while.
+ */
+int myalloc_numa_node();
 
 /**
  * Description: Initialize the memory allocator. 
@@ -23,48 +265,356 @@ enum allocation_algorithm {FIRST_FIT, BEST_FIT, WORST_FIT};
  *              The memory chunk must be pre-faulted.
  *              Its content initialized to 0 (using memset).
  */
-void initialize_allocator(int _size, enum allocation_algorithm _aalgorithm);
+void initialize_allocator(size_t _size, enum allocation_algorithm _aalgorithm);
+
+/**
+ * Description: Same as initialize_allocator(), with _flags being a combination of enum allocator_flags.
+ */
+void initialize_allocator_with_flags(size_t _size, enum allocation_algorithm _aalgorithm, int _flags);
+
+/**
+ * Description: Same as initialize_allocator_with_flags(), with the persistent memory chunk in the file at _path
+ *              (see myalloc_open()).
+ */
+void initialize_allocator_from_file(const char* _path, size_t _size, enum allocation_algorithm _aalgorithm, int _flags);
+
+/**
+ * Description: Stores _ptr as the root block of a persistent allocator, the block the data in the memory chunk is
+ *              found from after a restart. The root is moved with the memory chunk when the file is mapped at
+ *              another address. Pointers stored inside blocks are not, so blocks should refer to each other by their
+ *              offset from the root.
+ */
+void set_root(void* _ptr);
+
+/**
+ * Description: Returns the root block set with set_root(), NULL if none was set.
+ */
+void* get_root();
+
+/**
+ * Description: Returns the offset of the block at _ptr from the start of the memory chunk. Offsets stay valid when
+ *              the memory chunk is mapped at another address, so they can be stored in blocks or sent to another
+ *              process that maps the same memory chunk.
+ */
+size_t to_offset(void* _ptr);
+
+/**
+ * Description: Returns the block at _offset from the start of the memory chunk, see to_offset().
+ */
+void* from_offset(size_t _offset);
+
+/**
+ * Description: Makes the calling thread the owner of the allocator. With MYALLOC_DEFERRED_FREE, deallocate() on any
+ *              other thread pushes the block on a lock-free stack instead of taking the lock, and the stack is
+ *              returned to the free lists by the next allocation. The thread that creates an allocator owns it.
+ */
+void set_owner();
+
+/**
+ * Description: Takes the locks of the allocator so that fork() does not copy it in the middle of an operation of
+ *              another thread. Meant for pthread_atfork(): call prefork() before fork() and postfork() after it in
+ *              both the parent and the child. Chunks in the caches of the threads that do not exist in the child stay
+ *              allocated in the child.
+ */
+void prefork();
+
+/**
+ * Description: Releases the locks taken by prefork().
+ */
+void postfork();
 
 /**
  * Description: Similar to malloc call in C.
  *              Returns a pointer to the allocated block of size _size.
  *              If allocation cannot be satisfied, returns NULL.
+ *              Every block takes at least 56 bytes of the memory chunk with its boundary tags, whatever _size is,
+ *              unless it is a slot (MYALLOC_SLABS) or a region block.
  */
-void* allocate(int _size);
+void* allocate(size_t _size);
+
+/**
+ * Description: Similar to aligned_alloc call in C.
+ *              Returns a pointer to an allocated block of size _size whose address is a multiple of _alignment,
+ *              which must be a power of two. If allocation cannot be satisfied, returns NULL.
+ *              Blocks aligned beyond the minimum alignment of the allocator are not moved by compaction.
+ */
+void* allocate_aligned(size_t _size, size_t _alignment);
 
 /**
  * Description: Similar to free call in C.
  *              Takes a pointer to a chunk of memory as the sole parameter and returns it back to the allocator.
+ *              A pointer that is not an allocated block (a double free, a pointer into a block or outside the
+ *              memory chunk) is found in constant time with the block map and ignored with an error message.
+ *              Built with -DMYALLOC_HARDENED it aborts instead, and so does a block whose tags or canary were
+ *              overwritten.
  * Precondition: The pointer is a valid entry in memory and the allocated lists.
  */
 void deallocate(void* _ptr);
 
+/**
+ * Description: Similar to realloc call in C.
+ *              Resizes the block at _ptr to _size bytes and returns its address. A block grows in place by taking
+ *              the room of the free chunk right after it and shrinks in place by returning its tail to the free lists,
+ *              it is only moved (copied to a new block and freed) when the chunk after it is allocated or too small.
+ *              A moved block has the minimum alignment of the allocator. If the block cannot be resized,
+ *              returns NULL and the block is left as it was. A NULL _ptr allocates a new block.
+ * Precondition: The pointer is NULL or an allocated block.
+ */
+void* reallocate(void* _ptr, size_t _size);
+
+/**
+ * Description: Returns true if _ptr points into the memory chunk of the allocator, so a program that mixes this
+ *              allocator with another one can tell whose block it has. Takes constant time and no lock.
+ */
+bool contains(void* _ptr);
+
+/**
+ * Description: Similar to malloc_usable_size call in C.
+ *              Returns the number of bytes of the block at _ptr that can be used, at least the requested size.
+ *              Returns 0 for pointers that are not allocated blocks and for blocks of a region.
+ */
+size_t usable_size(void* _ptr);
+
+/**
+ * Description: Allocates _n blocks, block i of size _sizes[i], and stores them in _out with a single lock
+ *              acquisition. The blocks are carved one after the other from one free chunk when a free chunk can hold
+ *              all of them. Returns the number of blocks allocated, _out[i] is NULL for every block that could not be.
+ */
+int allocate_batch(const size_t* _sizes, int _n, void** _out);
+
+/**
+ * Description: Returns the _n blocks in _ptrs back to the allocator with a single lock acquisition. The blocks are
+ *              coalesced in one pass in address order, so blocks that are next to each other are merged before they
+ *              enter the free lists.
+ *              Pointers that are not allocated blocks are reported and skipped like in deallocate().
+ */
+void deallocate_batch(void* const* _ptrs, int _n);
+
+/**
+ * Description: Starts a region of _size bytes for the calling thread. Until region_end(), allocate() on this thread
+ *              returns the next bytes of the region instead of searching the free lists, and deallocate() of a block
+ *              of the region does nothing. The region is one chunk of the memory chunk that compaction does not move.
+ *              Returns false if no free chunk can hold the region.
+ * Precondition: The calling thread has no region.
+ */
+bool region_begin(size_t _size);
+
+/**
+ * Description: Releases every block allocated in the region of the calling thread at once, the next allocate()
+ *              starts at the beginning of the region again. Takes constant time and no lock.
+ */
+void region_reset();
+
+/**
+ * Description: Ends the region of the calling thread and returns its memory to the allocator. Blocks allocated in the
+ *              region must not be used afterwards.
+ */
+void region_end();
+
 /**
  * Description: Returns the available memory (bytes) as an integer.
+ *              The value is maintained by every operation and can be read without the lock.
  */
-int available_memory();
+size_t available_memory();
 
 /**
  * Description: Returns the used memory (bytes) as an integer.
+ *              The value is maintained by every operation and can be read without the lock.
  */
-int used_memory();
+size_t used_memory();
 
 /**
  * Description: Prints the statistics of the memory allocator.
  */
 void print_statistics();
 
+// Snapshot of the allocator statistics, see get_statistics()
+struct myalloc_stats {
+    size_t allocated_size;          // size of the memory chunk
+    int allocated_chunks;
+    size_t used_size;
+    size_t free_size;
+    int free_chunks;
+    size_t largest_free_chunk_size;
+    size_t smallest_free_chunk_size;
+};
+
+/**
+ * Description: Fills _stats with the fields printed by print_statistics().
+ *              The sizes and chunk counts are read without the lock. Only the largest and smallest free chunk
+ *              sizes take the lock, and they scan one list at most.
+ */
+void get_statistics(struct myalloc_stats* _stats);
+
+/**
+ * Description: Same as get_statistics(), for _allocator.
+ */
+void myalloc_get_statistics(struct Myalloc* _allocator, struct myalloc_stats* _stats);
+
+#ifdef MYALLOC_TRACE
+#include <stdint.h>
+
+enum myalloc_trace_op {MYALLOC_TRACE_ALLOCATE, MYALLOC_TRACE_DEALLOCATE, MYALLOC_TRACE_REALLOCATE};
+
+// One sampled call, see set_trace()
+struct myalloc_trace_event {
+    enum myalloc_trace_op op;
+    void* ptr;              // block returned or deallocated, NULL when an allocation failed
+    void* old_ptr;          // block passed to reallocate()
+    size_t size;            // requested size, or the size of the deallocated block (0 if not known)
+    void* caller;           // return address of the call into the allocator
+    uint64_t time_ns;       // CLOCK_MONOTONIC time at the end of the call
+    uint64_t latency_ns;
+};
+
+// Called by sampled calls with the recorded event
+typedef void (*myalloc_trace_fn)(const struct myalloc_trace_event* _event, void* _arg);
+
+/**
+ * Description: Samples every _period-th allocate(), allocate_aligned(), deallocate() and reallocate() call of each
+ *              thread, 0 turns sampling off. A sampled call is written to a lock-free ring of 4096 events that
+ *              trace_drain() reads, and passed to _fn(event, _arg) right after the call if _fn is not NULL.
+ *              The event holds the block, the size, the return address of the call and its latency.
+ *              Only built with -DMYALLOC_TRACE, otherwise the calls carry no tracing code at all.
+ * Precondition: A callback that is replaced while other threads allocate may still be called once for a call that
+ *               was in flight, with either argument.
+ */
+void set_trace(unsigned _period, myalloc_trace_fn _fn, void* _arg);
+
+/**
+ * Description: Moves up to _max of the oldest recorded events from the trace ring to _events and returns how many
+ *              were moved. Any thread can drain the ring while others allocate.
+ */
+int trace_drain(struct myalloc_trace_event* _events, int _max);
+
+/**
+ * Description: Returns the number of sampled events that were lost because the trace ring was full.
+ */
+size_t trace_dropped();
+
+/**
+ * Description: Same as set_trace(), for the calls on _allocator. Returns false and changes nothing if _fn is not NULL
+ *              and _allocator is shared, since other processes can not call a function of this one; the trace ring of
+ *              a shared allocator is shared too, any process can drain it.
+ */
+bool myalloc_set_trace(struct Myalloc* _allocator, unsigned _period, myalloc_trace_fn _fn, void* _arg);
+
+/**
+ * Description: Same as trace_drain(), for the trace ring of _allocator.
+ */
+int myalloc_trace_drain(struct Myalloc* _allocator, struct myalloc_trace_event* _events, int _max);
+
+/**
+ * Description: Same as trace_dropped(), for the trace ring of _allocator.
+ */
+size_t myalloc_trace_dropped(struct Myalloc* _allocator);
+#endif
+
 /**
  * Description: Returns true if there is fragmentation. False if there is no fragmentation.
  */
 bool is_fragmented();
 
+/**
+ * Description: Fills _report with the fragmentation of the memory chunk: the free memory and how much of it the
+ *              largest free chunk holds, histograms of the free and allocated chunk sizes and the bytes taken by
+ *              the boundary tags. Nothing is changed, so it is safe to call from a monitoring thread. It walks every
+ *              chunk under the lock, so it takes time linear in the number of chunks.
+ */
+void get_fragmentation_report(struct myalloc_fragmentation_report* _report);
+
 /**
  * Description: Compaction will be performed by grouping the allocated memory blocks in the beginning of the memory
  *              chunk and combining the free memory at the end of the memory chunk.
+ *              Every allocated block is moved at most once, so _before and _after need room for as many entries
+ *              as there are allocated chunks (see get_statistics()).
  */
 int compact_allocation(void** _before, void** _after);
 
+// One block moved by compaction, see compact_allocation_table()
+struct myalloc_relocation {
+    void* before;
+    void* after;
+};
+
+/**
+ * Description: Same as compact_allocation(), but returns the moved blocks in a table allocated with malloc that
+ *              has room for every allocated block, so the caller does not have to guess an array size.
+ *              *_count is set to the number of entries filled in. The caller frees the table with free().
+ *              Returns NULL (and sets *_count to 0) without compacting if the table can not be allocated.
+ */
+struct myalloc_relocation* compact_allocation_table(int* _count);
+
+// Called by compact_step() for every moved block with its old and new address
+typedef void (*myalloc_relocation_fn)(void* _before, void* _after, void* _arg);
+
+/**
+ * Description: Performs a bounded part of a compaction, so compaction can be spread over many calls that each hold
+ *              the allocator lock for a short time. A step moves blocks until about _budget bytes have been moved
+ *              (at least one block), and calls _relocated(before, after, _arg) for every moved block.
+ *              Allocations and deallocations can happen between steps. Returns true while the compaction has more
+ *              to do, false once it has reached the end of the memory chunk.
+ *              A step only takes the allocator lock: chunks in thread caches are not moved, and the free memory next
+ *              to them stays where it is until compact_allocation() empties the caches.
+ */
+bool compact_step(size_t _budget, myalloc_relocation_fn _relocated, void* _arg);
+
+/**
+ * Description: Same as compact_allocation_table(), compacts the memory chunk of _allocator.
+ */
+struct myalloc_relocation* myalloc_compact_table(struct Myalloc* _allocator, int* _count);
+
+/**
+ * Description: Same as compact_step(), for _allocator.
+ */
+bool myalloc_compact_step(struct Myalloc* _allocator, size_t _budget, myalloc_relocation_fn _relocated, void* _arg);
+
+/**
+ * Description: Allocates a movable block of size _size and returns a handle to it, or -1 if allocation cannot be
+ *              satisfied. The handle stays valid until deallocate_handle(), while compaction is free to move the
+ *              block and updates the handle instead of reporting the move.
+ *              With MYALLOC_NUMA the handles come from the arena of the thread that called initialize_allocator().
+ */
+int allocate_handle(size_t _size);
+
+/**
+ * Description: Returns the current address of the block of _handle and pins it, so compaction does not move it
+ *              until the matching handle_unpin(). Pins nest, the block stays in place until every pin is released.
+ */
+void* handle_pin(int _handle);
+
+/**
+ * Description: Releases one pin of _handle taken by handle_pin(). The address returned by handle_pin() must not be
+ *              used once the last pin is released.
+ */
+void handle_unpin(int _handle);
+
+/**
+ * Description: Returns the block of _handle back to the allocator and releases the handle.
+ * Precondition: _handle was returned by allocate_handle(), is not pinned and has not been deallocated.
+ */
+void deallocate_handle(int _handle);
+
+/**
+ * Description: Same as allocate_handle(), served from _allocator.
+ */
+int myalloc_alloc_handle(struct Myalloc* _allocator, size_t _size);
+
+/**
+ * Description: Same as handle_pin(), for a handle of _allocator.
+ */
+void* myalloc_handle_pin(struct Myalloc* _allocator, int _handle);
+
+/**
+ * Description: Same as handle_unpin(), for a handle of _allocator.
+ */
+void myalloc_handle_unpin(struct Myalloc* _allocator, int _handle);
+
+/**
+ * Description: Same as deallocate_handle(), for a handle of _allocator.
+ */
+void myalloc_free_handle(struct Myalloc* _allocator, int _handle);
+
 /**
  * Description: Releases any dynamically allocated memory in your contiguous allocator.
  */
@@ -0,0 +1,248 @@
+/*
+ * Filename: preload.c
+ *
+ * Description: LD_PRELOAD shim that serves malloc(), free(), calloc(), realloc(), posix_memalign() and
+ *              malloc_usable_size() of an unmodified program from the custom memory allocator.
+ *
+ *              Usage: LD_PRELOAD=./libmyalloc.so program [args]
+ *
+ *              The allocator is created on the first call: a growable SEGREGATED_FIT allocator with thread caches
+ *              and slabs that aligns every block to 16 bytes like glibc. MYALLOC_ALGORITHM (0-3, see enum
+ *              allocation_algorithm), MYALLOC_FLAGS (enum allocator_flags, the chunk is only growable if they say so)
+ *              and MYALLOC_SIZE (initial size of the memory chunk in bytes) in the environment override them.
+ *              Requests the allocator can not serve (larger than 256 MB, or when it is out of memory) and calls the
+ *              allocator makes itself go to glibc, and free() hands every block that is not in the memory chunk to
+ *              glibc, so blocks of both allocators can be mixed safely.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myalloc.h"
+
+// Functions of the shim that replace the ones of glibc, everything else in the library is hidden
+#define EXPORT __attribute__((visibility("default")))
+
+// Requests above PRELOAD_MAX_SIZE go to glibc, which maps them with mmap anyway
+#define PRELOAD_MAX_SIZE ((size_t)256 << 20)
+// Initial size of the memory chunk, it grows as needed unless MYALLOC_FLAGS leave out MYALLOC_GROWABLE
+#define PRELOAD_INITIAL_SIZE (1 << 20)
+// malloc() returns blocks aligned for any type, 16 bytes on x86-64 and arm64
+#define PRELOAD_ALIGNMENT 16
+
+// The allocator functions of glibc, called directly so a fallback never comes back to the shim
+extern void* __libc_malloc(size_t _size);
+extern void __libc_free(void* _ptr);
+extern void* __libc_calloc(size_t _n, size_t _size);
+extern void* __libc_realloc(void* _ptr, size_t _size);
+extern void* __libc_memalign(size_t _alignment, size_t _size);
+
+// NULL until the first call, and for good if the allocator can not be created
+static _Atomic(struct Myalloc*) preload_allocator = NULL;
+static pthread_once_t preload_once = PTHREAD_ONCE_INIT;
+// glibc's malloc_usable_size(), which has no __libc_ name
+static _Atomic(size_t (*)(void*)) libc_usable_size = NULL;
+
+// Set while the calling thread is inside the allocator, the calls to malloc() it makes go to glibc
+//      - initial-exec so that reading it never allocates the thread's TLS block
+static __thread bool reentered __attribute__((tls_model("initial-exec"))) = false;
+
+static void preload_prefork() {
+    myalloc_prefork(preload_allocator);
+}
+
+static void preload_postfork() {
+    myalloc_postfork(preload_allocator);
+}
+
+/**
+ * Description: Creates the allocator with the algorithm and flags from the environment.
+ */
+static void preload_init() {
+    enum allocation_algorithm algorithm = SEGREGATED_FIT;
+    int flags = MYALLOC_THREAD_CACHE | MYALLOC_SLABS | MYALLOC_GROWABLE;
+    size_t size = PRELOAD_INITIAL_SIZE;
+    const char* env = getenv("MYALLOC_ALGORITHM");
+    if (env != NULL && atoi(env) >= FIRST_FIT && atoi(env) <= SEGREGATED_FIT) {
+        algorithm = atoi(env);
+    }
+    env = getenv("MYALLOC_FLAGS");
+    if (env != NULL) {
+        flags = strtol(env, NULL, 0) & 0xff;
+    }
+    env = getenv("MYALLOC_SIZE");
+    if (env != NULL && strtoull(env, NULL, 0) != 0) {
+        size = strtoull(env, NULL, 0);
+    }
+    // blocks need the alignment of malloc()
+    flags |= MYALLOC_MIN_ALIGNMENT(PRELOAD_ALIGNMENT);
+
+    struct Myalloc *allocator = myalloc_create(size, algorithm, flags);
+    if (allocator != NULL) {
+        atomic_store_explicit(&preload_allocator, allocator, memory_order_release);
+        pthread_atfork(preload_prefork, preload_postfork, preload_postfork);
+    }
+}
+
+/**
+ * Description: Returns a block of _size bytes aligned to _alignment from the allocator,
+ *              or NULL if the request has to go to glibc.
+ */
+static void* preload_allocate(size_t _size, size_t _alignment) {
+    if (reentered || _size > PRELOAD_MAX_SIZE) {
+        return NULL;
+    }
+    reentered = true;
+    struct Myalloc *allocator = atomic_load_explicit(&preload_allocator, memory_order_acquire);
+    if (allocator == NULL) {
+        pthread_once(&preload_once, preload_init);
+        allocator = atomic_load_explicit(&preload_allocator, memory_order_acquire);
+    }
+    void* ptr = NULL;
+    if (allocator != NULL) {
+        // malloc(0) returns a unique pointer
+        size_t size = _size != 0 ? _size : 1;
+        ptr = _alignment <= PRELOAD_ALIGNMENT ? myalloc_alloc(allocator, size) : myalloc_alloc_aligned(allocator, size, _alignment);
+    }
+    reentered = false;
+    return ptr;
+}
+
+/**
+ * Description: Returns the allocator if _ptr is one of its blocks, NULL if it belongs to glibc.
+ */
+static struct Myalloc* preload_owner(void* _ptr) {
+    struct Myalloc *allocator = atomic_load_explicit(&preload_allocator, memory_order_acquire);
+    return allocator != NULL && myalloc_contains(allocator, _ptr) ? allocator : NULL;
+}
+
+EXPORT void* malloc(size_t _size) {
+    void* ptr = preload_allocate(_size, 0);
+    return ptr != NULL ? ptr : __libc_malloc(_size);
+}
+
+EXPORT void free(void* _ptr) {
+    if (_ptr == NULL) {
+        return;
+    }
+    struct Myalloc *allocator = preload_owner(_ptr);
+    if (allocator == NULL) {
+        __libc_free(_ptr);
+        return;
+    }
+    bool outer = reentered;
+    reentered = true;
+    myalloc_free(allocator, _ptr);
+    reentered = outer;
+}
+
+EXPORT void* calloc(size_t _n, size_t _size) {
+    size_t size;
+    if (__builtin_mul_overflow(_n, _size, &size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    // freed chunks are handed out again without being cleared
+    void* ptr = preload_allocate(size, 0);
+    if (ptr == NULL) {
+        return __libc_calloc(_n, _size);
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+EXPORT void* realloc(void* _ptr, size_t _size) {
+    if (_ptr == NULL) {
+        return malloc(_size);
+    }
+    struct Myalloc *allocator = preload_owner(_ptr);
+    if (allocator == NULL) {
+        return __libc_realloc(_ptr, _size);
+    }
+    if (_size == 0) {
+        free(_ptr);
+        return NULL;
+    }
+    void* ptr = NULL;
+    if (!reentered && _size <= PRELOAD_MAX_SIZE) {
+        reentered = true;
+        ptr = myalloc_realloc(allocator, _ptr, _size);
+        reentered = false;
+    }
+    if (ptr == NULL) {
+        // the block is too large for the allocator now, it moves to glibc
+        ptr = __libc_malloc(_size);
+        if (ptr != NULL) {
+            size_t old_size = myalloc_usable_size(allocator, _ptr);
+            memcpy(ptr, _ptr, old_size < _size ? old_size : _size);
+            free(_ptr);
+        }
+    }
+    return ptr;
+}
+
+EXPORT void* reallocarray(void* _ptr, size_t _n, size_t _size) {
+    size_t size;
+    if (__builtin_mul_overflow(_n, _size, &size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(_ptr, size);
+}
+
+EXPORT int posix_memalign(void** _out, size_t _alignment, size_t _size) {
+    if (_alignment < sizeof(void*) || (_alignment & (_alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void* ptr = preload_allocate(_size, _alignment);
+    if (ptr == NULL) {
+        ptr = __libc_memalign(_alignment, _size);
+        if (ptr == NULL) {
+            return ENOMEM;
+        }
+    }
+    *_out = ptr;
+    return 0;
+}
+
+EXPORT void* aligned_alloc(size_t _alignment, size_t _size) {
+    if (_alignment == 0 || (_alignment & (_alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    void* ptr = preload_allocate(_size, _alignment);
+    return ptr != NULL ? ptr : __libc_memalign(_alignment, _size);
+}
+
+EXPORT void* memalign(size_t _alignment, size_t _size) {
+    return aligned_alloc(_alignment, _size);
+}
+
+EXPORT size_t malloc_usable_size(void* _ptr) {
+    if (_ptr == NULL) {
+        return 0;
+    }
+    struct Myalloc *allocator = preload_owner(_ptr);
+    if (allocator != NULL) {
+        return myalloc_usable_size(allocator, _ptr);
+    }
+    size_t (*usable_size)(void*) = atomic_load_explicit(&libc_usable_size, memory_order_relaxed);
+    if (usable_size == NULL) {
+        // dlsym() may allocate
+        bool outer = reentered;
+        reentered = true;
+        usable_size = (size_t (*)(void*))dlsym(RTLD_NEXT, "malloc_usable_size");
+        reentered = outer;
+        if (usable_size == NULL) {
+            return 0;
+        }
+        atomic_store_explicit(&libc_usable_size, usable_size, memory_order_relaxed);
+    }
+    return usable_size(_ptr);
+}
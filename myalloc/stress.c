@@ -0,0 +1,413 @@
+/*
+ * Filename: stress.c
+ *
+ * Description: Multi-threaded scalability benchmark and stress test for the custom memory allocator.
+ *              Runs 1, 2, 4, ... up to -t threads against each allocator configuration and glibc malloc and reports
+ *              the throughput, the speedup over one thread and the time the threads waited for a mutex.
+ *
+ *              The mixed phase allocates, reallocates and frees blocks of 16 to 1024 bytes, and hands every third
+ *              block to another thread through a shared table, so many blocks are freed by a thread that did not
+ *              allocate them. The compaction phase does the same with handles while one more thread compacts the
+ *              allocator in a loop. Every block carries a stamp that is checked before it is freed, and the program
+ *              exits with an error when a stamp was overwritten or memory leaked.
+ *
+ *              Usage: ./stress [-n ops_per_thread] [-t max_threads]
+ *
+ *              Lock waits are measured by wrapping pthread_mutex_lock() at link time (-Wl,--wrap): a lock that is
+ *              not free at the first try counts as contended, and the time until it is acquired is its wait.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "myalloc.h"
+
+// Blocks a thread keeps for itself
+#define PRIVATE_SLOTS 256
+// Blocks shared between the threads, a block put there is freed by the next thread that takes its slot
+#define SHARED_SLOTS 4096
+#define MIN_BLOCK 16
+#define MAX_BLOCK 1024
+#define STAMP 0x5eedf00dcafe0000ull
+
+// Allocator configuration under test
+struct stress_allocator {
+    const char* name;
+    bool libc;
+    int flags;
+};
+
+static const struct stress_allocator allocators[] = {
+    { "locked", false, MYALLOC_GROWABLE },
+    { "tcache", false, MYALLOC_GROWABLE | MYALLOC_THREAD_CACHE },
+    { "tcache+slabs", false, MYALLOC_GROWABLE | MYALLOC_THREAD_CACHE | MYALLOC_SLABS },
+    { "deferred", false, MYALLOC_GROWABLE | MYALLOC_DEFERRED_FREE },
+    { "glibc", true, 0 },
+};
+
+// State of one thread
+struct worker {
+    pthread_t thread;
+    uint64_t seed;
+    uint64_t wait_ns;       // time spent waiting for contended mutexes
+    uint64_t contended;     // number of contended lock acquisitions
+    size_t errors;
+};
+
+// State of a run, one phase and allocator with a number of threads
+struct run {
+    const struct stress_allocator *allocator;
+    struct Myalloc *heap;
+    size_t ops;
+    _Atomic(void*) shared[SHARED_SLOTS];
+    atomic_int shared_handles[SHARED_SLOTS];
+    atomic_bool done;
+    size_t compactions;
+};
+
+static __thread uint64_t lock_wait_ns = 0;
+static __thread uint64_t lock_contended = 0;
+
+int __real_pthread_mutex_lock(pthread_mutex_t* _mutex);
+
+/**
+ * Description: Locks _mutex, timing the wait when it is held by another thread.
+ */
+int __wrap_pthread_mutex_lock(pthread_mutex_t* _mutex) {
+    if (pthread_mutex_trylock(_mutex) == 0) {
+        return 0;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = __real_pthread_mutex_lock(_mutex);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    lock_wait_ns += (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec;
+    lock_contended++;
+    return result;
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t* _state) {
+    uint64_t x = *_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *_state = x;
+}
+
+/**
+ * Description: Writes the stamp of a block of _size bytes: its size in the first word and the low byte of the
+ *              size in the last byte.
+ */
+static void stamp(void* _ptr, size_t _size) {
+    *(uint64_t*)_ptr = STAMP | _size;
+    ((unsigned char*)_ptr)[_size - 1] = (unsigned char)_size;
+}
+
+/**
+ * Description: Returns the size of the block at _ptr from its stamp, or 0 if the stamp was overwritten.
+ */
+static size_t check_stamp(void* _ptr) {
+    uint64_t word = *(uint64_t*)_ptr;
+    size_t size = word & 0xffff;
+    if ((word & ~0xffffull) != STAMP || size < MIN_BLOCK || size > MAX_BLOCK ||
+        ((unsigned char*)_ptr)[size - 1] != (unsigned char)size) {
+        return 0;
+    }
+    return size;
+}
+
+static void* stress_alloc(struct run* _run, size_t _size) {
+    void* ptr = _run->allocator->libc ? malloc(_size) : myalloc_alloc(_run->heap, _size);
+    if (ptr != NULL) {
+        stamp(ptr, _size);
+    }
+    return ptr;
+}
+
+static void* stress_realloc(struct run* _run, void* _ptr, size_t _size) {
+    void* ptr = _run->allocator->libc ? realloc(_ptr, _size) : myalloc_realloc(_run->heap, _ptr, _size);
+    if (ptr != NULL) {
+        stamp(ptr, _size);
+    }
+    return ptr;
+}
+
+/**
+ * Description: Checks the stamp of the block at _ptr and frees it. Returns false if the stamp was overwritten.
+ */
+static bool stress_free(struct run* _run, void* _ptr) {
+    bool valid = check_stamp(_ptr) != 0;
+    if (_run->allocator->libc) {
+        free(_ptr);
+    } else {
+        myalloc_free(_run->heap, _ptr);
+    }
+    return valid;
+}
+
+/**
+ * Description: Mixed phase: private allocations and frees, reallocations, short-lived blocks and blocks handed to
+ *              other threads through the shared table.
+ */
+static void mixed_ops(struct run* _run, struct worker* _worker) {
+    void* own[PRIVATE_SLOTS] = {NULL};
+    uint64_t state = _worker->seed;
+    for (size_t i = 0; i < _run->ops; i++) {
+        uint64_t r = next_random(&state);
+        size_t size = MIN_BLOCK + (r >> 16) % (MAX_BLOCK - MIN_BLOCK + 1);
+        size_t choice = r % 100;
+        if (choice < 40) {
+            size_t slot = (r >> 32) % PRIVATE_SLOTS;
+            if (own[slot] != NULL) {
+                _worker->errors += !stress_free(_run, own[slot]);
+                own[slot] = NULL;
+            } else {
+                own[slot] = stress_alloc(_run, size);
+            }
+        } else if (choice < 70) {
+            // the block that was in the slot was most likely allocated by another thread
+            void* ptr = stress_alloc(_run, size);
+            void* old = atomic_exchange(&_run->shared[(r >> 32) % SHARED_SLOTS], ptr);
+            if (old != NULL) {
+                _worker->errors += !stress_free(_run, old);
+            }
+        } else if (choice < 80) {
+            size_t slot = (r >> 32) % PRIVATE_SLOTS;
+            if (own[slot] != NULL) {
+                _worker->errors += check_stamp(own[slot]) == 0;
+                void* ptr = stress_realloc(_run, own[slot], size);
+                if (ptr != NULL) {
+                    own[slot] = ptr;
+                }
+            }
+        } else {
+            void* ptr = stress_alloc(_run, size);
+            if (ptr != NULL) {
+                _worker->errors += !stress_free(_run, ptr);
+            }
+        }
+    }
+    for (size_t slot = 0; slot < PRIVATE_SLOTS; slot++) {
+        if (own[slot] != NULL) {
+            _worker->errors += !stress_free(_run, own[slot]);
+        }
+    }
+}
+
+/**
+ * Description: Pins _handle, checks its stamp, unpins it and frees it. Returns false if the stamp was overwritten.
+ */
+static bool free_handle(struct run* _run, int _handle) {
+    bool valid = check_stamp(myalloc_handle_pin(_run->heap, _handle)) != 0;
+    myalloc_handle_unpin(_run->heap, _handle);
+    myalloc_free_handle(_run->heap, _handle);
+    return valid;
+}
+
+/**
+ * Description: Compaction phase: like the mixed phase with handle blocks, which compaction may move whenever they
+ *              are not pinned.
+ */
+static void handle_ops(struct run* _run, struct worker* _worker) {
+    int own[PRIVATE_SLOTS];
+    for (size_t slot = 0; slot < PRIVATE_SLOTS; slot++) {
+        own[slot] = -1;
+    }
+    uint64_t state = _worker->seed;
+    for (size_t i = 0; i < _run->ops; i++) {
+        uint64_t r = next_random(&state);
+        size_t size = MIN_BLOCK + (r >> 16) % (MAX_BLOCK - MIN_BLOCK + 1);
+        size_t slot = (r >> 32) % PRIVATE_SLOTS;
+        if (r % 100 < 50 && own[slot] != -1) {
+            _worker->errors += !free_handle(_run, own[slot]);
+            own[slot] = -1;
+            continue;
+        }
+        // the block is stamped before another thread can see its handle
+        int handle = myalloc_alloc_handle(_run->heap, size);
+        if (handle != -1) {
+            stamp(myalloc_handle_pin(_run->heap, handle), size);
+            myalloc_handle_unpin(_run->heap, handle);
+        }
+        if (r % 100 < 50) {
+            own[slot] = handle;
+        } else {
+            int old = atomic_exchange(&_run->shared_handles[(r >> 32) % SHARED_SLOTS], handle);
+            if (old != -1) {
+                _worker->errors += !free_handle(_run, old);
+            }
+        }
+    }
+    for (size_t slot = 0; slot < PRIVATE_SLOTS; slot++) {
+        if (own[slot] != -1) {
+            _worker->errors += !free_handle(_run, own[slot]);
+        }
+    }
+}
+
+struct worker_arg {
+    struct run *run;
+    struct worker *worker;
+    void (*ops)(struct run*, struct worker*);
+};
+
+static void* work(void* _arg) {
+    struct worker_arg *arg = _arg;
+    lock_wait_ns = 0;
+    lock_contended = 0;
+    arg->ops(arg->run, arg->worker);
+    arg->worker->wait_ns = lock_wait_ns;
+    arg->worker->contended = lock_contended;
+    return NULL;
+}
+
+/**
+ * Description: Compacts the allocator until the workers are done. Every handle block that is not pinned moves.
+ */
+static void* compact_loop(void* _run) {
+    struct run *run = _run;
+    while (!atomic_load(&run->done)) {
+        int count = 0;
+        free(myalloc_compact_table(run->heap, &count));
+        run->compactions++;
+    }
+    return NULL;
+}
+
+/**
+ * Description: Runs _threads threads doing _ops operations of _work each against _allocator and prints one row of
+ *              the results. Returns the number of errors found, including leaked memory, and updates *_base to the
+ *              throughput of the run with one thread.
+ */
+static size_t run_stress(const char* _phase, void (*_work)(struct run*, struct worker*),
+                         const struct stress_allocator* _allocator, int _threads, size_t _ops, double* _base) {
+    struct run *run = calloc(1, sizeof(struct run));
+    run->allocator = _allocator;
+    run->ops = _ops;
+    for (int slot = 0; slot < SHARED_SLOTS; slot++) {
+        atomic_init(&run->shared_handles[slot], -1);
+    }
+    if (!_allocator->libc) {
+        run->heap = myalloc_create(16 << 20, FIRST_FIT, _allocator->flags);
+        if (run->heap == NULL) {
+            printf("Could not create the allocator.\n");
+            exit(1);
+        }
+    }
+    struct worker *workers = calloc(_threads, sizeof(struct worker));
+    struct worker_arg *args = calloc(_threads, sizeof(struct worker_arg));
+    pthread_t compactor;
+    bool compacting = _work == handle_ops;
+
+    uint64_t start = now_ns();
+    if (compacting) {
+        pthread_create(&compactor, NULL, compact_loop, run);
+    }
+    for (int t = 0; t < _threads; t++) {
+        workers[t].seed = 0x9e3779b97f4a7c15ull * (t + 1);
+        args[t] = (struct worker_arg){ run, &workers[t], _work };
+        pthread_create(&workers[t].thread, NULL, work, &args[t]);
+    }
+    for (int t = 0; t < _threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    uint64_t elapsed = now_ns() - start;
+    if (compacting) {
+        atomic_store(&run->done, true);
+        pthread_join(compactor, NULL);
+    }
+
+    size_t errors = 0;
+    uint64_t wait_ns = 0;
+    uint64_t contended = 0;
+    for (int t = 0; t < _threads; t++) {
+        errors += workers[t].errors;
+        wait_ns += workers[t].wait_ns;
+        contended += workers[t].contended;
+    }
+    for (int slot = 0; slot < SHARED_SLOTS; slot++) {
+        if (run->shared[slot] != NULL) {
+            errors += !stress_free(run, run->shared[slot]);
+        }
+        if (run->shared_handles[slot] != -1) {
+            errors += !free_handle(run, run->shared_handles[slot]);
+        }
+    }
+    if (!_allocator->libc) {
+        // compaction returns the cached chunks, slabs keep one empty slab per size class
+        int count = 0;
+        free(myalloc_compact_table(run->heap, &count));
+        if (!(_allocator->flags & MYALLOC_SLABS) && myalloc_used_memory(run->heap) != 0) {
+            printf("Leaked %zu bytes.\n", myalloc_used_memory(run->heap));
+            errors++;
+        }
+        myalloc_destroy(run->heap);
+    }
+
+    double throughput = (double)_ops * _threads * 1e9 / elapsed;
+    if (_threads == 1) {
+        *_base = throughput;
+    }
+    char compactions[16] = "-";
+    if (compacting) {
+        snprintf(compactions, sizeof(compactions), "%zu", run->compactions);
+    }
+    printf("%-10s %-13s %7d %12.0f %7.2fx %12.1f %7.1f%% %10lu %11s %6zu\n", _phase, _allocator->name, _threads,
+           throughput, throughput / *_base, wait_ns / 1e6, 100.0 * wait_ns / ((double)elapsed * _threads),
+           (unsigned long)contended, compactions, errors);
+    fflush(stdout);
+    free(args);
+    free(workers);
+    free(run);
+    return errors;
+}
+
+int main(int argc, char* argv[]) {
+    size_t ops = 100000;
+    int max_threads = 64;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            ops = strtoull(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            max_threads = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Usage: %s [-n ops_per_thread] [-t max_threads]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%-10s %-13s %7s %12s %8s %12s %8s %10s %11s %6s\n", "phase", "allocator", "threads", "ops/s", "speedup",
+           "lock wait ms", "wait", "contended", "compactions", "errors");
+    size_t errors = 0;
+    for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++) {
+        double base = 0;
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            errors += run_stress("mixed", mixed_ops, &allocators[a], threads, ops, &base);
+        }
+    }
+    for (size_t a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++) {
+        if (allocators[a].libc) {
+            continue;
+        }
+        double base = 0;
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            errors += run_stress("compaction", handle_ops, &allocators[a], threads, ops / 4, &base);
+        }
+    }
+    if (errors != 0) {
+        printf("%zu errors\n", errors);
+        return 1;
+    }
+    return 0;
+}
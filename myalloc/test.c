@@ -0,0 +1,1005 @@
+/*
+ * Filename: test.c
+ *
+ * Description: Deterministic checks of the documented behaviour of the custom memory allocator, one test per
+ *              feature.
+ *
+ *              Usage: ./myalloc_test                                       checks of the library
+ *                     LD_PRELOAD=./libmyalloc.so ./myalloc_test preload    checks of the shim
+ *                     MYALLOC_FLAGS=0 MYALLOC_SIZE=65536 LD_PRELOAD=./libmyalloc.so ./myalloc_test preload-fixed
+ *
+ *              make test also runs the checks built with -DMYALLOC_HARDENED, where the heap corruption checks run
+ *              too, each in a forked child that has to abort, and built with -DMYALLOC_TRACE, where the tracing is
+ *              checked.
+ *
+ *              pthread_mutex_lock() is wrapped at link time to count the times a thread takes the allocator lock,
+ *              and vfprintf() to count the errors the allocator reports on stderr.
+ *              Exits with the number of failed checks.
+ */
+
+#define _GNU_SOURCE
+#include <malloc.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "myalloc.h"
+
+static int failures = 0;
+
+// The mutex the calling thread locked last, the number of times it locked watched_lock and the number of locks it
+// took, recorded by the pthread_mutex_lock() wrapper (-Wl,--wrap=pthread_mutex_lock)
+static __thread pthread_mutex_t* last_lock = NULL;
+static __thread pthread_mutex_t* watched_lock = NULL;
+static __thread unsigned long watched_locks = 0;
+static __thread unsigned long locks_taken = 0;
+
+int __real_pthread_mutex_lock(pthread_mutex_t* _mutex);
+
+int __wrap_pthread_mutex_lock(pthread_mutex_t* _mutex) {
+    last_lock = _mutex;
+    locks_taken++;
+    if (_mutex == watched_lock) {
+        watched_locks++;
+    }
+    return __real_pthread_mutex_lock(_mutex);
+}
+
+// Number of errors the allocator reported on stderr, counted by the vfprintf() wrapper (-Wl,--wrap=vfprintf)
+static unsigned long errors_reported = 0;
+
+int __real_vfprintf(FILE* _stream, const char* _format, va_list _args);
+
+int __wrap_vfprintf(FILE* _stream, const char* _format, va_list _args) {
+    if (_stream == stderr) {
+        errors_reported++;
+    }
+    return __real_vfprintf(_stream, _format, _args);
+}
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * Description: Small blocks are slots of a slab of their power-of-two size, a slab counts as one allocated chunk, and
+ *              a slab whose slots are all free goes back to the memory chunk unless it is the last of its class.
+ *              Pointers into slots and free slots are reported in every build.
+ */
+static void test_slabs() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, SEGREGATED_FIT, MYALLOC_SLABS);
+    struct myalloc_stats stats;
+    myalloc_get_statistics(allocator, &stats);
+    int chunks = stats.allocated_chunks;
+    char* slots[2000];
+    for (int i = 0; i < 2000; i++) {
+        slots[i] = myalloc_alloc(allocator, 24);
+    }
+    CHECK(slots[1] == slots[0] + 32);
+    CHECK(myalloc_usable_size(allocator, slots[0]) >= 24 && myalloc_usable_size(allocator, slots[0]) <= 32);
+    // 507 slots of 32 bytes fit a slab
+    myalloc_get_statistics(allocator, &stats);
+    CHECK(stats.allocated_chunks == chunks + 4);
+    for (int i = 0; i < 2000; i++) {
+        myalloc_free(allocator, slots[i]);
+    }
+    myalloc_get_statistics(allocator, &stats);
+    CHECK(stats.allocated_chunks == chunks + 1);
+    // the slots of the kept slab are reused
+    CHECK(myalloc_alloc(allocator, 24) != NULL);
+    myalloc_get_statistics(allocator, &stats);
+    CHECK(stats.allocated_chunks == chunks + 1);
+#ifndef MYALLOC_HARDENED
+    // a pointer into a slot and a slot freed twice are reported and leave the slab as it was
+    char* slot = myalloc_alloc(allocator, 24);
+    unsigned long errors = errors_reported;
+    myalloc_free(allocator, slot + 8);
+    myalloc_free(allocator, slot);
+    myalloc_free(allocator, slot);
+    CHECK(errors_reported == errors + 2);
+    CHECK(myalloc_alloc(allocator, 24) == slot);
+    CHECK(myalloc_alloc(allocator, 24) != slot);
+#endif
+    myalloc_destroy(allocator);
+}
+
+/**
+ * Description: Each allocation algorithm picks its hole out of free chunks of 300, 100 and 200 KB in address order
+ *              and the free memory after them, all too large for the quarantine of a hardened build. SEGREGATED_FIT
+ *              takes the best fit of the request's own bin, or the head of the next non-empty bin when none of the
+ *              chunks of its bin fits.
+ */
+static void test_algorithms() {
+    const size_t holes[] = {300 << 10, 100 << 10, 200 << 10};
+    // hole picked for a 150 KB and a 110 KB request, 3 is the free memory after the holes
+    const int picks[][2] = {{0, 0}, {2, 2}, {3, 3}, {2, 2}};
+    for (int a = FIRST_FIT; a <= SEGREGATED_FIT; a++) {
+        struct Myalloc *allocator = myalloc_create(4 << 20, a, 0);
+        char* blocks[3];
+        char* last = NULL;
+        for (int i = 0; i < 3; i++) {
+            blocks[i] = myalloc_alloc(allocator, holes[i]);
+            last = myalloc_alloc(allocator, 16);
+        }
+        for (int i = 0; i < 3; i++) {
+            myalloc_free(allocator, blocks[i]);
+        }
+        char* ptr = myalloc_alloc(allocator, 150 << 10);
+        CHECK(picks[a][0] == 3 ? ptr > last : ptr == blocks[picks[a][0]]);
+        myalloc_free(allocator, ptr);
+        ptr = myalloc_alloc(allocator, 110 << 10);
+        CHECK(picks[a][1] == 3 ? ptr > last : ptr == blocks[picks[a][1]]);
+        myalloc_destroy(allocator);
+    }
+}
+
+/**
+ * Description: Once the thread cache holds a chunk of the class, allocating and freeing a block of any cached size
+ *              only takes the lock of the calling thread's cache, never the allocator lock, whatever the minimum
+ *              alignment. The smallest class holds the smallest chunk, and the classes stay apart with a large
+ *              minimum alignment, so they cover 16 times the alignment.
+ */
+static void test_thread_cache() {
+    const int flags[] = {0, MYALLOC_MIN_ALIGNMENT(16), MYALLOC_MIN_ALIGNMENT(64)};
+    const size_t sizes[] = {1, 8, 24, 40, 100, 200, 900};
+    for (int i = 0; i < 3; i++) {
+        struct Myalloc *uncached = myalloc_create(1 << 20, SEGREGATED_FIT, flags[i]);
+        struct Myalloc *allocator = myalloc_create(1 << 20, SEGREGATED_FIT, MYALLOC_THREAD_CACHE | flags[i]);
+        CHECK(myalloc_usable_size(allocator, myalloc_alloc(allocator, 8)) ==
+              myalloc_usable_size(uncached, myalloc_alloc(uncached, 8)));
+        myalloc_destroy(uncached);
+        // a block too large for the caches takes the allocator lock last
+        myalloc_free(allocator, myalloc_alloc(allocator, 10000));
+        watched_lock = last_lock;
+        for (int j = 0; j < (flags[i] == MYALLOC_MIN_ALIGNMENT(64) ? 7 : 6); j++) {
+            myalloc_free(allocator, myalloc_alloc(allocator, sizes[j]));
+            watched_locks = 0;
+            for (int k = 0; k < 1000; k++) {
+                myalloc_free(allocator, myalloc_alloc(allocator, sizes[j]));
+            }
+            CHECK(watched_locks == 0);
+        }
+        watched_lock = NULL;
+        myalloc_destroy(allocator);
+    }
+}
+
+/**
+ * Description: Aligned blocks start at a multiple of their alignment and give the padding in front of them back, and
+ *              with a minimum alignment every block is aligned. A minimum alignment above 4096 bytes is refused.
+ */
+static void test_aligned() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, FIRST_FIT, 0);
+    size_t used = myalloc_used_memory(allocator);
+    char* blocks[9];
+    for (int i = 0; i < 9; i++) {
+        size_t alignment = (size_t)16 << i;
+        blocks[i] = myalloc_alloc_aligned(allocator, 100, alignment);
+        CHECK(blocks[i] != NULL && (uintptr_t)blocks[i] % alignment == 0);
+        CHECK(myalloc_usable_size(allocator, blocks[i]) >= 100);
+        memset(blocks[i], 0xff, myalloc_usable_size(allocator, blocks[i]));
+    }
+    for (int i = 0; i < 9; i++) {
+        myalloc_free(allocator, blocks[i]);
+    }
+    myalloc_compact(allocator, NULL, NULL);
+    CHECK(myalloc_used_memory(allocator) == used);
+    myalloc_destroy(allocator);
+
+    allocator = myalloc_create(1 << 20, BEST_FIT, MYALLOC_MIN_ALIGNMENT(64));
+    bool aligned = true;
+    for (size_t size = 1; size < 300; size += 13) {
+        aligned = aligned && (uintptr_t)myalloc_alloc(allocator, size) % 64 == 0;
+    }
+    CHECK(aligned);
+    myalloc_destroy(allocator);
+    CHECK(myalloc_create(1 << 20, BEST_FIT, MYALLOC_MIN_ALIGNMENT(8192)) == NULL);
+}
+
+/**
+ * Description: Compaction slides the allocated blocks to the start of the memory chunk in one pass, moving each at
+ *              most once, reports every move in the relocation table and leaves a single free chunk.
+ */
+static void test_compact() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, BEST_FIT, 0);
+    char* blocks[20];
+    for (int i = 0; i < 20; i++) {
+        blocks[i] = myalloc_alloc(allocator, 1000);
+        memset(blocks[i], i, 1000);
+    }
+    for (int i = 1; i < 20; i += 2) {
+        myalloc_free(allocator, blocks[i]);
+        blocks[i] = NULL;
+    }
+#ifndef MYALLOC_HARDENED
+    // a hardened build keeps the freed blocks in the quarantine until compaction
+    CHECK(myalloc_is_fragmented(allocator));
+#endif
+
+    int count;
+    struct myalloc_relocation *table = myalloc_compact_table(allocator, &count);
+    // the first block stays where it is, the nine others each move once
+    CHECK(table != NULL && count == 9);
+    for (int i = 0; table != NULL && i < count; i++) {
+        int moved = -1;
+        for (int j = 0; j < 20; j++) {
+            if (blocks[j] == table[i].before) {
+                moved = j;
+            }
+        }
+        CHECK(moved > 0 && (char*)table[i].after < (char*)table[i].before);
+        if (moved > 0) {
+            blocks[moved] = table[i].after;
+        }
+    }
+    free(table);
+    bool intact = true;
+    for (int i = 0; i < 20; i += 2) {
+        for (int j = 0; j < 1000 && intact; j++) {
+            intact = blocks[i][j] == (char)i;
+        }
+    }
+    CHECK(intact);
+    CHECK(!myalloc_is_fragmented(allocator));
+    struct myalloc_stats stats;
+    myalloc_get_statistics(allocator, &stats);
+    CHECK(stats.free_chunks == 1 && stats.allocated_chunks == 10);
+    myalloc_destroy(allocator);
+}
+
+// Blocks of test_compact_step(), updated by the relocation callback
+struct moved_blocks {
+    char* blocks[64];
+    int moves;
+};
+
+static void update_block(void* _before, void* _after, void* _arg) {
+    struct moved_blocks *moved = _arg;
+    for (int i = 0; i < 64; i++) {
+        if (moved->blocks[i] == _before) {
+            moved->blocks[i] = _after;
+        }
+    }
+    moved->moves++;
+}
+
+/**
+ * Description: A compaction step only takes the allocator lock, and leaves the chunks in thread caches where they are
+ *              while it slides the allocated blocks around them.
+ */
+static void test_compact_step() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, SEGREGATED_FIT, MYALLOC_THREAD_CACHE);
+    // the cache of the small class is refilled with chunks from the start of the memory chunk
+    char* cached = myalloc_alloc(allocator, 8);
+    struct moved_blocks moved = {.moves = 0};
+    for (int i = 0; i < 64; i++) {
+        moved.blocks[i] = myalloc_alloc(allocator, 1000);
+        memset(moved.blocks[i], i, 1000);
+    }
+    myalloc_free(allocator, cached);
+    for (int i = 1; i < 64; i += 2) {
+        myalloc_free(allocator, moved.blocks[i]);
+        moved.blocks[i] = NULL;
+    }
+
+    int steps = 1;
+    locks_taken = 0;
+    while (myalloc_compact_step(allocator, 4096, update_block, &moved)) {
+        steps++;
+    }
+    CHECK(locks_taken == (unsigned long)steps);
+    CHECK(moved.moves == 31);
+    bool intact = true;
+    for (int i = 0; i < 64; i += 2) {
+        for (int j = 0; j < 1000 && intact; j++) {
+            intact = moved.blocks[i][j] == (char)i;
+        }
+    }
+    CHECK(intact);
+    cached = myalloc_alloc(allocator, 8);
+    CHECK(cached < moved.blocks[0]);
+    myalloc_destroy(allocator);
+}
+
+/**
+ * Description: Compaction moves the blocks of unpinned handles without reporting them and updates their handles,
+ *              and leaves a pinned block where it is. A handle block can not be freed with deallocate().
+ */
+static void test_handles() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, FIRST_FIT, 0);
+    size_t used = myalloc_used_memory(allocator);
+    char* gaps[10];
+    int handles[10];
+    char* blocks[10];
+    for (int i = 0; i < 10; i++) {
+        gaps[i] = myalloc_alloc(allocator, 1000);
+        handles[i] = myalloc_alloc_handle(allocator, 1000);
+        CHECK(handles[i] != -1);
+        blocks[i] = myalloc_handle_pin(allocator, handles[i]);
+        memset(blocks[i], i, 1000);
+        myalloc_handle_unpin(allocator, handles[i]);
+    }
+    for (int i = 0; i < 10; i++) {
+        myalloc_free(allocator, gaps[i]);
+    }
+    CHECK(myalloc_handle_pin(allocator, handles[5]) == blocks[5]);
+
+    void* before[20];
+    void* after[20];
+    CHECK(myalloc_compact(allocator, before, after) == 0);
+    bool intact = true;
+    for (int i = 0; i < 10; i++) {
+        char* block = myalloc_handle_pin(allocator, handles[i]);
+        CHECK(i == 5 ? block == blocks[5] : block < blocks[i]);
+        for (int j = 0; j < 1000 && intact; j++) {
+            intact = block[j] == (char)i;
+        }
+        myalloc_handle_unpin(allocator, handles[i]);
+    }
+    CHECK(intact);
+    myalloc_handle_unpin(allocator, handles[5]);
+#ifndef MYALLOC_HARDENED
+    unsigned long errors = errors_reported;
+    myalloc_free(allocator, myalloc_handle_pin(allocator, handles[0]));
+    myalloc_handle_unpin(allocator, handles[0]);
+    CHECK(errors_reported == errors + 1);
+#endif
+    for (int i = 0; i < 10; i++) {
+        myalloc_free_handle(allocator, handles[i]);
+    }
+    myalloc_compact(allocator, NULL, NULL);
+    CHECK(myalloc_used_memory(allocator) == used);
+    myalloc_destroy(allocator);
+}
+
+/**
+ * Description: The size tree orders free chunks of the same size by address, so BEST_FIT takes the lowest of them,
+ *              and gives the smallest and largest free chunk of the statistics. The chunks are too large for the
+ *              quarantine of a hardened build.
+ */
+static void test_size_tree() {
+    const size_t holes[] = {200 << 10, 100 << 10, 100 << 10, 300 << 10};
+    struct Myalloc *allocator = myalloc_create(4 << 20, BEST_FIT, 0);
+    char* blocks[4];
+    for (int i = 0; i < 4; i++) {
+        blocks[i] = myalloc_alloc(allocator, holes[i]);
+        CHECK(myalloc_alloc(allocator, 16) != NULL);
+    }
+    struct myalloc_stats stats;
+    myalloc_get_statistics(allocator, &stats);
+    size_t tail = stats.largest_free_chunk_size;
+    for (int i = 3; i >= 0; i--) {
+        myalloc_free(allocator, blocks[i]);
+    }
+    myalloc_get_statistics(allocator, &stats);
+    CHECK(stats.free_chunks == 5);
+    CHECK(stats.smallest_free_chunk_size >= holes[1] && stats.smallest_free_chunk_size < holes[1] + 64);
+    CHECK(stats.largest_free_chunk_size == tail);
+    CHECK(myalloc_alloc(allocator, 90 << 10) == blocks[1]);
+    CHECK(myalloc_alloc(allocator, 90 << 10) == blocks[2]);
+    CHECK(myalloc_alloc(allocator, 90 << 10) == blocks[0]);
+    myalloc_destroy(allocator);
+}
+
+// Block freed by another thread
+struct remote_block {
+    struct Myalloc *allocator;
+    char* ptr;
+};
+
+/**
+ * Description: Frees _arg on a thread that does not own the allocator of test_batches().
+ */
+static void* free_remote_block(void* _arg) {
+    struct remote_block *block = _arg;
+    myalloc_free(block->allocator, block->ptr);
+    return NULL;
+}
+
+/**
+ * Description: A batch is carved out of one free chunk in order and merged back into one, on the stack or with a
+ *              malloc'd copy for more than 64 blocks. A block that appears twice or was freed before is reported
+ *              once, and the blocks other threads deferred are returned with the batch.
+ */
+static void test_batches() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, FIRST_FIT, MYALLOC_DEFERRED_FREE);
+    myalloc_set_owner(allocator);
+    size_t used = myalloc_used_memory(allocator);
+    size_t sizes[100];
+    void* blocks[101];
+    for (int i = 0; i < 100; i++) {
+        sizes[i] = 8 + i * 24 % 200;
+    }
+    for (int n = 10; n <= 100; n += 90) {
+        CHECK(myalloc_alloc_batch(allocator, sizes, n, blocks) == n);
+        bool ordered = true;
+        for (int i = 1; i < n; i++) {
+            ordered = ordered && (char*)blocks[i] >= (char*)blocks[i - 1] + sizes[i - 1];
+        }
+        CHECK(ordered);
+        myalloc_free_batch(allocator, blocks, n);
+        myalloc_compact(allocator, NULL, NULL);
+        CHECK(myalloc_used_memory(allocator) == used);
+    }
+
+#ifndef MYALLOC_HARDENED
+    CHECK(myalloc_alloc_batch(allocator, sizes, 3, blocks) == 3);
+    myalloc_free(allocator, blocks[2]);
+    blocks[3] = blocks[0];
+    unsigned long errors = errors_reported;
+    myalloc_free_batch(allocator, blocks, 4);
+    CHECK(errors_reported == errors + 2);
+    CHECK(myalloc_used_memory(allocator) == used);
+#endif
+
+    // a block freed by another thread waits on the deferred stack until the batch takes the lock, the blocks are
+    // too large for the quarantine of a hardened build
+    struct remote_block remote = {allocator, myalloc_alloc(allocator, 100 << 10)};
+    blocks[0] = myalloc_alloc(allocator, 100 << 10);
+    pthread_t thread;
+    pthread_create(&thread, NULL, free_remote_block, &remote);
+    pthread_join(thread, NULL);
+    myalloc_free_batch(allocator, blocks, 1);
+    struct myalloc_stats stats;
+    myalloc_get_statistics(allocator, &stats);
+    CHECK(stats.allocated_chunks == 0);
+    myalloc_destroy(allocator);
+}
+
+/**
+ * Description: Blocks of a region are bump allocated, freed all at once and give their memory back with the region.
+ */
+static void test_regions() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, SEGREGATED_FIT, 0);
+    size_t used = myalloc_used_memory(allocator);
+    CHECK(myalloc_region_begin(allocator, 4096));
+    char* first = myalloc_alloc(allocator, 100);
+    char* second = myalloc_alloc(allocator, 100);
+    CHECK(first != NULL && second == first + 104);
+    // deallocate() of a region block does nothing, usable_size() does not know region blocks
+    myalloc_free(allocator, second);
+    CHECK(myalloc_alloc(allocator, 8) == second + 104);
+    CHECK(myalloc_usable_size(allocator, second) == 0);
+    myalloc_region_reset(allocator);
+    CHECK(myalloc_alloc(allocator, 100) == first);
+    myalloc_region_end(allocator);
+    // a hardened build keeps freed chunks in the quarantine until compaction
+    myalloc_compact(allocator, NULL, NULL);
+    CHECK(myalloc_used_memory(allocator) == used);
+    myalloc_destroy(allocator);
+}
+
+/**
+ * Description: Frees the region block _arg of another thread, which is not a block of this thread.
+ */
+static void* free_region_block(void* _arg) {
+    struct remote_block *block = _arg;
+    CHECK(myalloc_usable_size(block->allocator, block->ptr) == 0);
+#ifndef MYALLOC_HARDENED
+    CHECK(myalloc_realloc(block->allocator, block->ptr, 1000) == NULL);
+#endif
+    myalloc_free(block->allocator, block->ptr);
+    return NULL;
+}
+
+/**
+ * Description: The first block of a region starts where the region chunk does, freeing it from another thread
+ *              neither frees nor resizes the region. A hardened build aborts on it like on any invalid pointer.
+ */
+static void test_region_threads(int _flags) {
+    struct Myalloc *allocator = myalloc_create(1 << 20, SEGREGATED_FIT, _flags);
+    size_t used = myalloc_used_memory(allocator);
+    CHECK(myalloc_region_begin(allocator, 4096));
+    size_t region_used = myalloc_used_memory(allocator);
+    struct remote_block block = {allocator, myalloc_alloc(allocator, 100)};
+    pthread_t thread;
+    pthread_create(&thread, NULL, free_region_block, &block);
+    pthread_join(thread, NULL);
+    // the region chunk is still allocated, and the region goes on where it was
+    myalloc_free(allocator, myalloc_alloc(allocator, 100));
+    CHECK(myalloc_used_memory(allocator) == region_used);
+    CHECK(myalloc_alloc(allocator, 100) == block.ptr + 208);
+    myalloc_region_end(allocator);
+    myalloc_compact(allocator, NULL, NULL);
+    CHECK(myalloc_used_memory(allocator) == used);
+    myalloc_destroy(allocator);
+}
+
+/**
+ * Description: A block grows into the free chunk after it and shrinks by giving its tail back, it is only moved
+ *              when the chunk after it is allocated, and a block that can not grow is left as it was. The blocks are
+ *              too large for the quarantine of a hardened build.
+ */
+static void test_realloc() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, FIRST_FIT, 0);
+    char* block = myalloc_alloc(allocator, 100 << 10);
+    char* next = myalloc_alloc(allocator, 100 << 10);
+    char* last = myalloc_alloc(allocator, 16);
+    memset(block, 0x5a, 100 << 10);
+    myalloc_free(allocator, next);
+    CHECK(myalloc_realloc(allocator, block, 180 << 10) == block);
+    CHECK(myalloc_usable_size(allocator, block) >= 180 << 10 && block[(100 << 10) - 1] == 0x5a);
+    CHECK(myalloc_realloc(allocator, block, 20 << 10) == block);
+    // the tail is free again, between the block and the last one
+    next = myalloc_alloc(allocator, 150 << 10);
+    CHECK(next > block && next < last);
+
+    char* moved = myalloc_realloc(allocator, block, 300 << 10);
+    CHECK(moved != NULL && moved != block && moved[0] == 0x5a && moved[(20 << 10) - 1] == 0x5a);
+    size_t usable = myalloc_usable_size(allocator, moved);
+    CHECK(myalloc_realloc(allocator, moved, 2 << 20) == NULL);
+    CHECK(myalloc_usable_size(allocator, moved) == usable);
+    char* fresh = myalloc_realloc(allocator, NULL, 100);
+    CHECK(fresh != NULL && myalloc_usable_size(allocator, fresh) >= 100);
+    myalloc_destroy(allocator);
+}
+
+#ifdef MYALLOC_TRACE
+/**
+ * Description: Trace callback of test_trace(), counts the events in _arg.
+ */
+static void count_event(const struct myalloc_trace_event* _event, void* _arg) {
+    (*(int*)_arg)++;
+}
+
+/**
+ * Description: Every period-th call of a thread is passed to the callback and written to the trace ring with its
+ *              block and size, events that do not fit the ring are counted as dropped, and period 0 stops tracing.
+ */
+static void test_trace() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, BEST_FIT, 0);
+    int calls = 0;
+    CHECK(myalloc_set_trace(allocator, 1, count_event, &calls));
+    char* ptr = myalloc_alloc(allocator, 100);
+    char* moved = myalloc_realloc(allocator, ptr, 200);
+    myalloc_free(allocator, moved);
+    CHECK(calls == 3);
+    struct myalloc_trace_event events[8];
+    CHECK(myalloc_trace_drain(allocator, events, 8) == 3);
+    CHECK(events[0].op == MYALLOC_TRACE_ALLOCATE && events[0].ptr == ptr && events[0].size == 100);
+    CHECK(events[1].op == MYALLOC_TRACE_REALLOCATE && events[1].old_ptr == ptr && events[1].ptr == moved &&
+          events[1].size == 200);
+    CHECK(events[2].op == MYALLOC_TRACE_DEALLOCATE && events[2].ptr == moved);
+    CHECK(events[0].time_ns <= events[2].time_ns);
+
+    CHECK(myalloc_set_trace(allocator, 4, NULL, NULL));
+    for (int i = 0; i < 4; i++) {
+        myalloc_free(allocator, myalloc_alloc(allocator, 100));
+    }
+    CHECK(calls == 3 && myalloc_trace_drain(allocator, events, 8) == 2);
+
+    CHECK(myalloc_set_trace(allocator, 1, NULL, NULL));
+    for (int i = 0; i < 5000; i++) {
+        myalloc_free(allocator, myalloc_alloc(allocator, 100));
+    }
+    CHECK(myalloc_trace_dropped(allocator) == 10000 - 4096);
+    CHECK(myalloc_set_trace(allocator, 0, NULL, NULL));
+    int drained = 0;
+    while (myalloc_trace_drain(allocator, events, 8) > 0) {
+        drained++;
+    }
+    myalloc_free(allocator, myalloc_alloc(allocator, 100));
+    CHECK(drained == 4096 / 8 && myalloc_trace_drain(allocator, events, 8) == 0);
+    myalloc_destroy(allocator);
+}
+#endif
+
+/**
+ * Description: The fragmentation report counts every chunk once in its histogram, agrees with the statistics, and
+ *              its chunks with their tags always add up to the memory chunk. The free chunks are too large for the
+ *              quarantine of a hardened build.
+ */
+static void test_fragmentation_report() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, FIRST_FIT, 0);
+    struct myalloc_fragmentation_report report;
+    myalloc_get_fragmentation_report(allocator, &report);
+    CHECK(report.free_chunks == 1 && report.allocated_chunks == 0);
+    CHECK(report.largest_free_ratio == 1.0 && report.external_fragmentation == 0.0);
+    size_t total = report.free_size + report.header_overhead;
+
+    char* blocks[3];
+    for (int i = 0; i < 3; i++) {
+        blocks[i] = myalloc_alloc(allocator, 100 << 10);
+        CHECK(myalloc_alloc(allocator, 16) != NULL);
+    }
+    myalloc_free(allocator, blocks[0]);
+    myalloc_free(allocator, blocks[2]);
+    myalloc_get_fragmentation_report(allocator, &report);
+    struct myalloc_stats stats;
+    myalloc_get_statistics(allocator, &stats);
+    CHECK(report.free_chunks == 3 && report.allocated_chunks == 4);
+    CHECK(report.free_size == stats.free_size && report.largest_free_chunk_size == stats.largest_free_chunk_size);
+    CHECK(report.allocated_size + report.free_size + report.header_overhead == total);
+    CHECK(report.external_fragmentation == 1.0 - (double)report.largest_free_chunk_size / report.free_size);
+    // the two holes of 100 KB are in the bin of 64 to 128 KB
+    CHECK(report.free_histogram[16] == 2 && report.allocated_histogram[16] == 1);
+    size_t free_chunks = 0;
+    size_t allocated_chunks = 0;
+    for (int i = 0; i < MYALLOC_HISTOGRAM_BINS; i++) {
+        free_chunks += report.free_histogram[i];
+        allocated_chunks += report.allocated_histogram[i];
+    }
+    CHECK(free_chunks == 3 && allocated_chunks == 4);
+    myalloc_destroy(allocator);
+}
+
+// Blocks test_deferred_frees() frees on another thread
+struct remote_blocks {
+    struct Myalloc *allocator;
+    char* ptrs[4];
+    int n;
+};
+
+/**
+ * Description: Frees the blocks of _arg on a thread that does not own their allocator.
+ */
+static void* free_remote_blocks(void* _arg) {
+    struct remote_blocks *blocks = _arg;
+    for (int i = 0; i < blocks->n; i++) {
+        myalloc_free(blocks->allocator, blocks->ptrs[i]);
+    }
+    return NULL;
+}
+
+/**
+ * Description: Blocks and slots freed by a thread that does not own the allocator wait on the deferred stack, which
+ *              takes each of them once: a slot freed twice and a pointer into a slot are reported by the freeing
+ *              thread before they reach the stack.
+ */
+static void test_deferred_frees() {
+    struct Myalloc *allocator = myalloc_create(1 << 20, FIRST_FIT, MYALLOC_DEFERRED_FREE | MYALLOC_SLABS);
+    myalloc_set_owner(allocator);
+    // the slab stays, it is the last of its class
+    myalloc_free(allocator, myalloc_alloc(allocator, 24));
+    size_t used = myalloc_used_memory(allocator);
+    char* slot = myalloc_alloc(allocator, 24);
+    char* next = myalloc_alloc(allocator, 24);
+    struct remote_blocks blocks = {allocator, {myalloc_alloc(allocator, 1000), slot}, 2};
+    pthread_t thread;
+    pthread_create(&thread, NULL, free_remote_blocks, &blocks);
+    pthread_join(thread, NULL);
+    CHECK(myalloc_used_memory(allocator) > used);
+#ifndef MYALLOC_HARDENED
+    blocks.ptrs[0] = slot;
+    blocks.ptrs[1] = next + 8;
+    unsigned long errors = errors_reported;
+    pthread_create(&thread, NULL, free_remote_blocks, &blocks);
+    pthread_join(thread, NULL);
+    CHECK(errors_reported == errors + 2);
+#endif
+    // the next allocation returns the deferred blocks
+    myalloc_free(allocator, next);
+    CHECK(myalloc_used_memory(allocator) == used);
+    CHECK(myalloc_alloc(allocator, 24) == slot);
+    CHECK(myalloc_alloc(allocator, 24) == next);
+    CHECK(myalloc_alloc(allocator, 24) == next + 32);
+    myalloc_destroy(allocator);
+}
+
+/**
+ * Description: Without NUMA support there is one node, and arenas and node bindings fall back to plain allocators.
+ */
+static void test_numa() {
+    int nodes = myalloc_numa_nodes();
+    CHECK(nodes >= 1 && nodes <= MYALLOC_MAX_NUMA_NODES);
+    int node = myalloc_numa_node();
+    CHECK(node >= 0 && node < nodes);
+
+    initialize_allocator_with_flags(1 << 20, SEGREGATED_FIT, MYALLOC_NUMA);
+    size_t used = used_memory();
+    void* ptr = allocate(1000);
+    CHECK(ptr != NULL && contains(ptr));
+    deallocate(ptr);
+    compact_allocation(NULL, NULL);
+    CHECK(used_memory() == used);
+    destroy_allocator();
+
+    // a node the system does not have can not be bound to, the memory comes from anywhere
+    struct Myalloc *allocator = myalloc_create(1 << 20, SEGREGATED_FIT, MYALLOC_NUMA_NODE(nodes));
+    CHECK(allocator != NULL);
+    ptr = myalloc_alloc(allocator, 1000);
+    CHECK(ptr != NULL);
+    myalloc_free(allocator, ptr);
+    myalloc_destroy(allocator);
+}
+
+/**
+ * Description: A persistent allocator keeps its blocks and root across a close, and can only be open once.
+ */
+static void test_persistent() {
+    char path[] = "/tmp/myalloc_test_XXXXXX";
+    int file = mkstemp(path);
+    CHECK(file != -1);
+    close(file);
+
+    struct Myalloc *allocator = myalloc_open(path, 1 << 20, BEST_FIT, 0);
+    CHECK(allocator != NULL);
+    char* root = myalloc_alloc(allocator, 64);
+    strcpy(root, "persistent root");
+    myalloc_set_root(allocator, root);
+    size_t used = myalloc_used_memory(allocator);
+    CHECK(myalloc_open(path, 1 << 20, BEST_FIT, 0) == NULL);
+    myalloc_destroy(allocator);
+
+    // the file may be mapped anywhere, only the root tells where the blocks are
+    allocator = myalloc_open(path, 0, FIRST_FIT, 0);
+    CHECK(allocator != NULL);
+    root = myalloc_get_root(allocator);
+    CHECK(root != NULL && strcmp(root, "persistent root") == 0);
+    CHECK(myalloc_used_memory(allocator) == used);
+    CHECK(myalloc_alloc_handle(allocator, 64) == -1);
+    myalloc_free(allocator, root);
+    myalloc_destroy(allocator);
+    unlink(path);
+}
+
+/**
+ * Description: Child side of test_shm(): attaches to the allocator, checks the message at _offset and frees it.
+ */
+static int shm_child(const char* _name, const char* _offset) {
+    struct Myalloc *allocator = myalloc_shm_attach(_name);
+    if (allocator == NULL) {
+        return 1;
+    }
+    char* message = myalloc_from_offset(allocator, strtoull(_offset, NULL, 10));
+    int status = strcmp(message, "shared message") == 0 ? 0 : 2;
+    myalloc_free(allocator, message);
+    myalloc_destroy(allocator);
+    return status;
+}
+
+/**
+ * Description: A block of a shared allocator is found by its offset in another process, which can free it.
+ */
+static void test_shm(const char* _self) {
+    char name[64];
+    snprintf(name, sizeof(name), "/myalloc_test_%d", (int)getpid());
+    struct Myalloc *allocator = myalloc_shm_create(name, 1 << 20, SEGREGATED_FIT, 0);
+    CHECK(allocator != NULL);
+    CHECK(myalloc_shm_create(name, 1 << 20, SEGREGATED_FIT, 0) == NULL);
+    CHECK(myalloc_shm_attach("/myalloc_test_missing") == NULL);
+#ifdef MYALLOC_TRACE
+    // a callback of this process can not be called by the others, the shared trace ring can be drained by any
+    CHECK(!myalloc_set_trace(allocator, 1, (myalloc_trace_fn)abort, NULL));
+    CHECK(myalloc_set_trace(allocator, 1, NULL, NULL));
+#endif
+    size_t used = myalloc_used_memory(allocator);
+    char* message = myalloc_alloc(allocator, 64);
+    strcpy(message, "shared message");
+
+    // a forked child inherits the mapping, the attaching process has to be a new program
+    char offset[32];
+    snprintf(offset, sizeof(offset), "%zu", myalloc_to_offset(allocator, message));
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(_self, _self, "shm-child", name, offset, (char*)NULL);
+        _exit(3);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    myalloc_compact(allocator, NULL, NULL);
+    CHECK(myalloc_used_memory(allocator) == used);
+#ifdef MYALLOC_TRACE
+    struct myalloc_trace_event events[4];
+    CHECK(myalloc_trace_drain(allocator, events, 4) == 2 && events[1].op == MYALLOC_TRACE_DEALLOCATE);
+#endif
+    myalloc_destroy(allocator);
+    shm_unlink(name);
+}
+
+/**
+ * Description: contains() knows the blocks of a memory chunk malloc'd from glibc's heap, and not the glibc blocks that
+ *              follow it.
+ */
+static void test_contains() {
+    struct Myalloc *allocator = myalloc_create(1 << 16, SEGREGATED_FIT, 0);
+    char* ptr = myalloc_alloc(allocator, 100);
+    char* next = malloc(100000);
+    CHECK(myalloc_contains(allocator, ptr));
+    CHECK(!myalloc_contains(allocator, next));
+    CHECK(!myalloc_contains(allocator, ptr + (1 << 16) + 4096));
+    free(next);
+    myalloc_free(allocator, ptr);
+    myalloc_destroy(allocator);
+}
+
+#ifdef MYALLOC_HARDENED
+/**
+ * Description: Runs case _c of test_hardened() in a child and returns true if the child aborted.
+ */
+static bool aborts(int _c, int _flags) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        // the report of the allocator is expected
+        freopen("/dev/null", "w", stderr);
+        struct Myalloc *allocator = myalloc_create(1 << 20, SEGREGATED_FIT, _flags);
+        char* ptr = myalloc_alloc(allocator, 100);
+        switch (_c) {
+            case 0:     // overflow into the canary
+                ptr[myalloc_usable_size(allocator, ptr)] = 1;
+                myalloc_free(allocator, ptr);
+                break;
+            case 1:     // double free
+                myalloc_free(allocator, ptr);
+                myalloc_free(allocator, ptr);
+                break;
+            case 2:     // write after free, found when the block is reused or leaves the quarantine
+                myalloc_free(allocator, ptr);
+                ptr[0] = 1;
+                for (int i = 0; i < 1000; i++) {
+                    myalloc_free(allocator, myalloc_alloc(allocator, 100));
+                }
+                myalloc_compact(allocator, NULL, NULL);
+                break;
+            case 3:     // another thread frees the first block of a region
+                test_region_threads(_flags);
+                break;
+            case 4:     // write after a batch free
+                myalloc_free_batch(allocator, (void* const*)&ptr, 1);
+                ptr[0] = 1;
+                for (int i = 0; i < 1000; i++) {
+                    myalloc_free(allocator, myalloc_alloc(allocator, 100));
+                }
+                myalloc_compact(allocator, NULL, NULL);
+                break;
+        }
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+/**
+ * Description: A hardened build aborts on overflows, double frees, writes after free and after a batch free and frees
+ *              of region blocks on other threads, with and without thread caches and slabs, and never on a block that
+ *              is used within its usable size.
+ */
+static void test_hardened() {
+    const int flags[] = {0, MYALLOC_THREAD_CACHE, MYALLOC_THREAD_CACHE | MYALLOC_SLABS};
+    for (int i = 0; i < 3; i++) {
+        CHECK(aborts(0, flags[i]));
+        CHECK(aborts(1, flags[i]));
+        CHECK(aborts(2, flags[i]));
+        CHECK(aborts(4, flags[i]));
+    }
+    CHECK(aborts(3, 0));
+    CHECK(aborts(3, MYALLOC_DEFERRED_FREE));
+    struct Myalloc *allocator = myalloc_create(1 << 20, SEGREGATED_FIT, MYALLOC_THREAD_CACHE | MYALLOC_SLABS);
+    for (size_t size = 1; size < 2000; size += 7) {
+        char* ptr = myalloc_alloc(allocator, size);
+        memset(ptr, 0xff, myalloc_usable_size(allocator, ptr));
+        myalloc_free(allocator, ptr);
+    }
+    myalloc_destroy(allocator);
+}
+#endif
+
+/**
+ * Description: Checks of the LD_PRELOAD shim, run with libmyalloc.so preloaded: requests the allocator can not serve
+ *              and blocks it did not allocate go to glibc, and the allocator works in a forked child.
+ */
+static void test_preload() {
+    char* small = malloc(24);
+    CHECK(small != NULL && ((uintptr_t)small & 15) == 0 && malloc_usable_size(small) >= 24);
+    memset(small, 0xff, 24);
+    free(small);
+    CHECK(malloc(0) != NULL);
+
+    // larger than the allocator serves, and a block that moves from the allocator to glibc
+    char* large = malloc((size_t)300 << 20);
+    CHECK(large != NULL && malloc_usable_size(large) >= (size_t)300 << 20);
+    free(large);
+    char* moved = malloc(100);
+    memset(moved, 0x5a, 100);
+    moved = realloc(moved, (size_t)300 << 20);
+    CHECK(moved != NULL && moved[0] == 0x5a && moved[99] == 0x5a);
+    free(moved);
+
+    // a block glibc allocated itself is freed by glibc
+    extern void* __libc_malloc(size_t _size);
+    char* foreign = __libc_malloc(100);
+    CHECK(malloc_usable_size(foreign) >= 100);
+    foreign = realloc(foreign, 200);
+    CHECK(foreign != NULL && malloc_usable_size(foreign) >= 200);
+    free(foreign);
+
+    char* dirty = malloc(1000);
+    memset(dirty, 0xff, 1000);
+    free(dirty);
+    unsigned char* zeroed = calloc(1000, 1);
+    bool all_zero = zeroed != NULL;
+    for (int i = 0; all_zero && i < 1000; i++) {
+        all_zero = zeroed[i] == 0;
+    }
+    CHECK(all_zero);
+    free(zeroed);
+    // volatile, so the compiler does not see the overflow
+    volatile size_t n = SIZE_MAX / 2;
+    CHECK(calloc(n, 4) == NULL);
+
+    void* aligned = NULL;
+    CHECK(posix_memalign(&aligned, 4096, 100) == 0 && ((uintptr_t)aligned & 4095) == 0);
+    free(aligned);
+    CHECK(posix_memalign(&aligned, 12, 100) != 0);
+    aligned = aligned_alloc(64, 256);
+    CHECK(aligned != NULL && ((uintptr_t)aligned & 63) == 0);
+    free(aligned);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        void* ptr = malloc(100);
+        free(ptr);
+        _exit(ptr != NULL ? 0 : 1);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/**
+ * Description: Checks of the LD_PRELOAD shim with a fixed memory chunk malloc'd from glibc's heap
+ *              (MYALLOC_FLAGS=0 MYALLOC_SIZE=65536): a glibc block right after the chunk is freed by glibc.
+ */
+static void test_preload_fixed() {
+    char* ptr = malloc(100);
+    // the chunk can not serve it, glibc takes it from the top of its heap after the chunk
+    char* next = malloc(100000);
+    CHECK(ptr != NULL && next != NULL && malloc_usable_size(next) >= 100000);
+    next = realloc(next, 100008);
+    CHECK(next != NULL && malloc_usable_size(next) >= 100008);
+    free(next);
+    CHECK(malloc(100000) == next);
+    free(ptr);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 4 && strcmp(argv[1], "shm-child") == 0) {
+        return shm_child(argv[2], argv[3]);
+    }
+    if (argc == 2 && strcmp(argv[1], "preload") == 0) {
+        test_preload();
+    } else if (argc == 2 && strcmp(argv[1], "preload-fixed") == 0) {
+        test_preload_fixed();
+        test_preload();
+    } else {
+        test_slabs();
+        test_algorithms();
+        test_thread_cache();
+        test_aligned();
+        test_compact();
+        test_compact_step();
+        test_handles();
+        test_size_tree();
+        test_batches();
+        test_regions();
+#ifndef MYALLOC_HARDENED
+        test_region_threads(0);
+        test_region_threads(MYALLOC_DEFERRED_FREE);
+#endif
+        test_realloc();
+#ifdef MYALLOC_TRACE
+        test_trace();
+#endif
+        test_fragmentation_report();
+        test_deferred_frees();
+        test_numa();
+        test_persistent();
+        test_shm(argv[0]);
+        test_contains();
+#ifdef MYALLOC_HARDENED
+        test_hardened();
+#endif
+    }
+    printf("%s: %d checks failed\n", argv[0], failures);
+    return failures;
+}